@@ -0,0 +1,232 @@
+#include "brickCuller.h"
+#include <algorithm>
+#include <cmath>
+
+void brickCuller::boxes::add(const glm::vec3& min, const glm::vec3& max) {
+    for (int a = 0; a < 3; a++)
+    {
+        center[a].push_back((min[a] + max[a]) * 0.5f);
+        extent[a].push_back((max[a] - min[a]) * 0.5f);
+    }
+    count++;
+}
+
+void brickCuller::boxes::pad() {
+    for (int a = 0; a < 3; a++)
+    {
+        center[a].resize(count + 8, 0.0f);
+        extent[a].resize(count + 8, 0.0f);
+    }
+}
+
+/// a box is outside if it is completely behind one plane and inside if it is completely in front of all planes
+static unsigned char classifyBox(bool behindPlane, bool crossingPlane) {
+    if (behindPlane)
+        return brickCuller::outside;
+    return crossingPlane ? brickCuller::intersecting : brickCuller::inside;
+}
+
+static void classifyScalar(const float* const center[3], const float* const extent[3], size_t first, size_t last, const float planes[6][4], float margin, unsigned char* result) {
+    for (size_t i = first; i < last; i++)
+    {
+        float outsideDistance = 1.0f, insideDistance = 1.0f;
+        for (int p = 0; p < 6; p++)
+        {
+            // distance of the center and the projection of the extent to the normal of the plane
+            const float d = planes[p][0] * center[0][i] + planes[p][1] * center[1][i] + planes[p][2] * center[2][i] + planes[p][3];
+            const float r = std::fabs(planes[p][0]) * (extent[0][i] + margin) + std::fabs(planes[p][1]) * (extent[1][i] + margin) + std::fabs(planes[p][2]) * (extent[2][i] + margin);
+            outsideDistance = std::min(outsideDistance, d + r);
+            insideDistance = std::min(insideDistance, d - r);
+        }
+        result[i] = classifyBox(outsideDistance < 0.0f, insideDistance < 0.0f);
+    }
+}
+
+/// tests 4 boxes at once, the bits of the masks tell which boxes are outside of some plane or not inside of every plane
+static void classifySSE(const float* const center[3], const float* const extent[3], size_t first, size_t last, const float planes[6][4], float margin, unsigned char* result) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 marginV = _mm_set1_ps(margin);
+    for (size_t i = first; i < last; i += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(center[0] + i), cy = _mm_loadu_ps(center[1] + i), cz = _mm_loadu_ps(center[2] + i);
+        const __m128 ex = _mm_add_ps(_mm_loadu_ps(extent[0] + i), marginV);
+        const __m128 ey = _mm_add_ps(_mm_loadu_ps(extent[1] + i), marginV);
+        const __m128 ez = _mm_add_ps(_mm_loadu_ps(extent[2] + i), marginV);
+
+        int outsideMask = 0, intersectingMask = 0;
+        for (int p = 0; p < 6; p++)
+        {
+            const __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p][0]), cx), _mm_mul_ps(_mm_set1_ps(planes[p][1]), cy)),
+                _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes[p][2]), cz), _mm_set1_ps(planes[p][3])));
+            const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(std::fabs(planes[p][0])), ex), _mm_mul_ps(_mm_set1_ps(std::fabs(planes[p][1])), ey)),
+                _mm_mul_ps(_mm_set1_ps(std::fabs(planes[p][2])), ez));
+            outsideMask |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(d, r), zero));
+            intersectingMask |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(d, r), zero));
+        }
+
+        const size_t lanes = std::min<size_t>(4, last - i);
+        for (size_t lane = 0; lane < lanes; lane++)
+            result[i + lane] = classifyBox((outsideMask >> lane) & 1, (intersectingMask >> lane) & 1);
+    }
+}
+
+/// the same as classifySSE with 8 boxes at once
+PGR_TARGET_AVX static void classifyAVX(const float* const center[3], const float* const extent[3], size_t first, size_t last, const float planes[6][4], float margin, unsigned char* result) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 marginV = _mm256_set1_ps(margin);
+    for (size_t i = first; i < last; i += 8)
+    {
+        const __m256 cx = _mm256_loadu_ps(center[0] + i), cy = _mm256_loadu_ps(center[1] + i), cz = _mm256_loadu_ps(center[2] + i);
+        const __m256 ex = _mm256_add_ps(_mm256_loadu_ps(extent[0] + i), marginV);
+        const __m256 ey = _mm256_add_ps(_mm256_loadu_ps(extent[1] + i), marginV);
+        const __m256 ez = _mm256_add_ps(_mm256_loadu_ps(extent[2] + i), marginV);
+
+        int outsideMask = 0, intersectingMask = 0;
+        for (int p = 0; p < 6; p++)
+        {
+            const __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p][0]), cx), _mm256_mul_ps(_mm256_set1_ps(planes[p][1]), cy)),
+                _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes[p][2]), cz), _mm256_set1_ps(planes[p][3])));
+            const __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(std::fabs(planes[p][0])), ex), _mm256_mul_ps(_mm256_set1_ps(std::fabs(planes[p][1])), ey)),
+                _mm256_mul_ps(_mm256_set1_ps(std::fabs(planes[p][2])), ez));
+            outsideMask |= _mm256_movemask_ps(_mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_LT_OQ));
+            intersectingMask |= _mm256_movemask_ps(_mm256_cmp_ps(_mm256_sub_ps(d, r), zero, _CMP_LT_OQ));
+        }
+
+        const size_t lanes = std::min<size_t>(8, last - i);
+        for (size_t lane = 0; lane < lanes; lane++)
+            result[i + lane] = classifyBox((outsideMask >> lane) & 1, (intersectingMask >> lane) & 1);
+    }
+    _mm256_zeroupper();
+}
+
+brickCuller::brickCuller(unsigned int nx, unsigned int ny, unsigned int nz, float spacing, float extent, simd::level level)
+    : nx(nx), ny(ny), nz(nz), level(level) {
+    bricksX = (nx + brickCubes - 1) / brickCubes;
+    bricksY = (ny + brickCubes - 1) / brickCubes;
+    bricksZ = (nz + brickCubes - 1) / brickCubes;
+
+    // box of cubes from x0, y0, z0 to x1, y1, z1 (excluded), clamped to the grid
+    auto addBox = [=](boxes& to, unsigned int x0, unsigned int y0, unsigned int z0, unsigned int x1, unsigned int y1, unsigned int z1) {
+        x1 = std::min(x1, nx);
+        y1 = std::min(y1, ny);
+        z1 = std::min(z1, nz);
+        to.add(glm::vec3(spacing * x0 - extent, spacing * y0 - extent, spacing * z0 - extent),
+            glm::vec3(spacing * (x1 - 1) + extent, spacing * (y1 - 1) + extent, spacing * (z1 - 1) + extent));
+    };
+    const unsigned int superBrickCubes = brickCubes * superBrickBricks;
+
+    for (unsigned int sz = 0; sz < bricksZ; sz += superBrickBricks)
+    {
+        for (unsigned int sy = 0; sy < bricksY; sy += superBrickBricks)
+        {
+            for (unsigned int sx = 0; sx < bricksX; sx += superBrickBricks)
+            {
+                addBox(superBricks, sx * brickCubes, sy * brickCubes, sz * brickCubes,
+                    sx * brickCubes + superBrickCubes, sy * brickCubes + superBrickCubes, sz * brickCubes + superBrickCubes);
+                firstBrick.push_back((unsigned int)bricks.count);
+
+                for (unsigned int bz = sz; bz < std::min(sz + superBrickBricks, bricksZ); bz++)
+                {
+                    for (unsigned int by = sy; by < std::min(sy + superBrickBricks, bricksY); by++)
+                    {
+                        for (unsigned int bx = sx; bx < std::min(sx + superBrickBricks, bricksX); bx++)
+                        {
+                            addBox(bricks, bx * brickCubes, by * brickCubes, bz * brickCubes,
+                                (bx + 1) * brickCubes, (by + 1) * brickCubes, (bz + 1) * brickCubes);
+                            brickGridIndex.push_back(bx + by * bricksX + bz * bricksX * bricksY);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    firstBrick.push_back((unsigned int)bricks.count);
+
+    superBricks.pad();
+    bricks.pad();
+    superBrickResult.resize(superBricks.count);
+    brickResult.resize(bricks.count);
+    brickVisible.resize(bricks.count);
+}
+
+void brickCuller::classify(const boxes& tested, size_t first, size_t last, const float planes[6][4], float margin, unsigned char* result) const {
+    const float* const center[3] = { tested.center[0].data(), tested.center[1].data(), tested.center[2].data() };
+    const float* const extent[3] = { tested.extent[0].data(), tested.extent[1].data(), tested.extent[2].data() };
+    if (level == simd::avx)
+        classifyAVX(center, extent, first, last, planes, margin, result);
+    else if (level == simd::sse2)
+        classifySSE(center, extent, first, last, planes, margin, result);
+    else
+        classifyScalar(center, extent, first, last, planes, margin, result);
+}
+
+size_t brickCuller::cull(const glm::mat4& projectionView, float margin, std::vector<std::pair<size_t, size_t>>& runs) {
+    // planes of the frustum are sums and differences of the last row of the matrix with the other rows, normals point inside
+    float planes[6][4];
+    for (int p = 0; p < 6; p++)
+    {
+        const int row = p / 2;
+        const float sign = p % 2 == 0 ? 1.0f : -1.0f;
+        for (int c = 0; c < 4; c++)
+            planes[p][c] = projectionView[c][3] + sign * projectionView[c][row];
+    }
+
+    classify(superBricks, 0, superBricks.count, planes, margin, superBrickResult.data());
+
+    std::fill(brickVisible.begin(), brickVisible.end(), 0);
+    nVisibleBricks = 0;
+    for (size_t s = 0; s < superBricks.count; s++)
+    {
+        if (superBrickResult[s] == outside)
+            continue;
+
+        // only bricks of super bricks crossing the frustum are tested
+        if (superBrickResult[s] == intersecting)
+            classify(bricks, firstBrick[s], firstBrick[s + 1], planes, margin, brickResult.data());
+
+        for (size_t b = firstBrick[s]; b < firstBrick[s + 1]; b++)
+        {
+            if (superBrickResult[s] == inside || brickResult[b] != outside) {
+                brickVisible[brickGridIndex[b]] = 1;
+                nVisibleBricks++;
+            }
+        }
+    }
+
+    // cubes are written in the order of their indices, so a row of cubes in neighbouring visible bricks is one range
+    runs.clear();
+    size_t visibleCubes = 0;
+    for (size_t z = 0; z < nz; z++)
+    {
+        for (size_t y = 0; y < ny; y++)
+        {
+            const unsigned char* row = brickVisible.data() + (y / brickCubes) * bricksX + (z / brickCubes) * bricksX * bricksY;
+            for (size_t bx = 0; bx < bricksX; bx++)
+            {
+                if (!row[bx])
+                    continue;
+
+                const size_t first = bx * brickCubes + (y + z * ny) * nx;
+                const size_t last = std::min<size_t>((bx + 1) * brickCubes, nx) + (y + z * ny) * nx;
+                if (!runs.empty() && runs.back().second == first)
+                    runs.back().second = last;
+                else
+                    runs.emplace_back(first, last);
+                visibleCubes += last - first;
+            }
+        }
+    }
+    return visibleCubes;
+}
+
+size_t brickCuller::visibleBricks() const {
+    return nVisibleBricks;
+}
+
+size_t brickCuller::totalBricks() const {
+    return bricks.count;
+}
+
+bool brickCuller::brickVisibleInLastCull(unsigned int gridIndex) const {
+    return brickVisible[gridIndex] != 0;
+}
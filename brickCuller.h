@@ -0,0 +1,71 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include "glm/glm.hpp"
+#include "simd.h"
+
+/// splits a grid of cubes to bricks and finds bricks inside the view frustum
+/// bricks are grouped to super bricks, bricks of a super brick completely inside or outside the frustum are not tested
+class brickCuller
+{
+public:
+    /// cubes along each axis of a brick and bricks along each axis of a super brick
+    static const unsigned int brickCubes = 8;
+    static const unsigned int superBrickBricks = 4;
+
+protected:
+    /// axis aligned boxes as a structure of arrays, padded so the last batch of 8 boxes can always be loaded whole
+    struct boxes {
+        std::vector<float> center[3];
+        std::vector<float> extent[3];
+        size_t count = 0;
+
+        void add(const glm::vec3& min, const glm::vec3& max);
+        void pad();
+    };
+
+    /// cubes of the grid along each axis
+    unsigned int nx, ny, nz;
+    /// bricks of the grid along each axis
+    unsigned int bricksX, bricksY, bricksZ;
+    /// instruction set used by box tests
+    simd::level level;
+
+    /// bricks are stored super brick after super brick, bricks of super brick s are from firstBrick[s] to firstBrick[s + 1]
+    boxes superBricks;
+    boxes bricks;
+    std::vector<unsigned int> firstBrick;
+    /// index of every stored brick in the grid of bricks (x + y * bricksX + z * bricksX * bricksY)
+    std::vector<unsigned int> brickGridIndex;
+
+    /// results of the last cull
+    std::vector<unsigned char> superBrickResult;
+    std::vector<unsigned char> brickResult;
+    std::vector<unsigned char> brickVisible;
+    size_t nVisibleBricks = 0;
+
+    /// writes outside, intersecting or inside for boxes from first to last to result
+    void classify(const boxes& tested, size_t first, size_t last, const float planes[6][4], float margin, unsigned char* result) const;
+
+public:
+    enum visibility : unsigned char {
+        outside = 0,
+        intersecting = 1,
+        inside = 2
+    };
+
+    /// cube x, y, z of a grid with nx, ny, nz cubes has its center at spacing * (x, y, z) and reaches extent to each side
+    brickCuller(unsigned int nx, unsigned int ny, unsigned int nz, float spacing, float extent, simd::level level);
+
+    /// fills runs with sorted and merged ranges of indices of cubes in visible bricks and returns the number of these cubes
+    /// margin enlarges every box, so cubes do not disappear when the camera moves between culling and drawing
+    size_t cull(const glm::mat4& projectionView, float margin, std::vector<std::pair<size_t, size_t>>& runs);
+
+    /// number of bricks found visible by the last cull
+    size_t visibleBricks() const;
+
+    size_t totalBricks() const;
+
+    /// true if brick x + y * bricksX + z * bricksX * bricksY of the grid was found visible by the last cull
+    bool brickVisibleInLastCull(unsigned int gridIndex) const;
+};
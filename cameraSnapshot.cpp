@@ -0,0 +1,67 @@
+#include "cameraSnapshot.h"
+#include <algorithm>
+
+cameraSnapshot::cameraSnapshot() {
+    for (std::atomic<float>& value : values)
+        value.store(0.0f, std::memory_order_relaxed);
+}
+
+void cameraSnapshot::publish(const camera& source, double stepTime) {
+    const glm::vec3 vectors[3] = { source.getPosition(), source.getDirection(), source.getUpVector() };
+    const unsigned int begin = sequence.load(std::memory_order_relaxed);
+
+    sequence.store(begin + 1, std::memory_order_relaxed);
+    // readers that see any of the new values see the odd sequence too
+    std::atomic_thread_fence(std::memory_order_release);
+    for (int i = 0; i < 9; i++)
+        values[i].store(values[9 + i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    for (int v = 0; v < 3; v++)
+    {
+        for (int c = 0; c < 3; c++)
+            values[9 + v * 3 + c].store(vectors[v][c], std::memory_order_relaxed);
+    }
+    time.store(stepTime, std::memory_order_relaxed);
+    sequence.store(begin + 2, std::memory_order_release);
+}
+
+void cameraSnapshot::readSteps(cameraState& previous, cameraState& last, double& lastTime) const {
+    cameraState* states[2] = { &previous, &last };
+    unsigned int begin, end;
+    do {
+        begin = sequence.load(std::memory_order_acquire);
+        for (int s = 0; s < 2; s++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                states[s]->position[c] = values[s * 9 + c].load(std::memory_order_relaxed);
+                states[s]->direction[c] = values[s * 9 + 3 + c].load(std::memory_order_relaxed);
+                states[s]->upVector[c] = values[s * 9 + 6 + c].load(std::memory_order_relaxed);
+            }
+        }
+        lastTime = time.load(std::memory_order_relaxed);
+        // the values are read before the sequence is checked again
+        std::atomic_thread_fence(std::memory_order_acquire);
+        end = sequence.load(std::memory_order_relaxed);
+    } while (begin != end || (begin & 1) != 0);
+}
+
+cameraState cameraSnapshot::read() const {
+    cameraState previous, last;
+    double lastTime;
+    readSteps(previous, last, lastTime);
+    return last;
+}
+
+cameraState cameraSnapshot::interpolate(double renderTime, double step) const {
+    cameraState previous, last;
+    double lastTime;
+    readSteps(previous, last, lastTime);
+
+    // the previous step is at lastTime - step, so renderTime - step lies between the steps unless the simulation is late
+    const float t = (float)std::min(std::max((renderTime - lastTime) / step, 0.0), 1.0);
+    cameraState state;
+    state.position = glm::mix(previous.position, last.position, t);
+    state.direction = glm::normalize(glm::mix(previous.direction, last.direction, t));
+    state.upVector = glm::normalize(glm::mix(previous.upVector, last.upVector, t));
+    return state;
+}
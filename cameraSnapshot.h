@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include "glm/glm.hpp"
+#include "camera.h"
+
+/// position, direction and up vector of a camera at one moment
+struct cameraState {
+    glm::vec3 position;
+    glm::vec3 direction;
+    glm::vec3 upVector;
+};
+
+/// the camera of the last two steps published by the thread updating the scene, a seqlock
+/// the writer makes the sequence odd while it writes, readers retry when it was odd or changed while they read, so nobody blocks
+class cameraSnapshot
+{
+protected:
+    std::atomic<unsigned int> sequence{ 0 };
+    /// position, direction and up vector of the previous and of the last step, atomics so reading them while they are written is not a data race
+    std::atomic<float> values[18];
+    /// time of the last step
+    std::atomic<double> time{ 0.0 };
+
+    /// reads both steps and the time of the last one consistently
+    void readSteps(cameraState& previous, cameraState& last, double& lastTime) const;
+
+public:
+    cameraSnapshot();
+
+    /// publishes the camera after the step at stepTime, the last published state becomes the previous one, only one thread may publish at a time
+    void publish(const camera& source, double stepTime);
+
+    /// camera after the last step
+    cameraState read() const;
+
+    /// camera one step before renderTime, interpolated between the two published steps, step is the length of a step
+    cameraState interpolate(double renderTime, double step) const;
+};
@@ -0,0 +1,137 @@
+#include "chunkResidency.h"
+#include <algorithm>
+#include <cmath>
+
+chunkResidency::chunkResidency(unsigned int nx, unsigned int ny, unsigned int nz, float spacing, float cubeExtent, float radius)
+    : nx(nx), ny(ny), nz(nz), spacing(spacing), cubeExtent(cubeExtent), loadRadius(radius) {
+    chunksX = (nx + chunkCubes - 1) / chunkCubes;
+    chunksY = (ny + chunkCubes - 1) / chunkCubes;
+    chunksZ = (nz + chunkCubes - 1) / chunkCubes;
+
+    // chunks are evicted one chunk farther than they are loaded, so moving back and forth does not load them again and again
+    evictRadius = loadRadius + chunkCubes * spacing;
+
+    chunkSlot.assign(chunksX * chunksY * chunksZ, -1);
+    slotChunk.resize(slotCount());
+    for (unsigned int slot = slotCount(); slot > 0; slot--)
+        freeSlots.push_back(slot - 1);
+}
+
+unsigned int chunkResidency::slotCount() const {
+    // a sphere of the evict radius crosses at most this many chunks along each axis, slots of evicted chunks come from its inside
+    const unsigned int alongAxis = (unsigned int)std::ceil(2.0f * evictRadius / (chunkCubes * spacing)) + 1;
+    return std::min(alongAxis * alongAxis * alongAxis, chunksX * chunksY * chunksZ);
+}
+
+float chunkResidency::distance(unsigned int chunk, const glm::vec3& camera) const {
+    const unsigned int c[3] = { chunk % chunksX, chunk / chunksX % chunksY, chunk / (chunksX * chunksY) };
+    const unsigned int n[3] = { nx, ny, nz };
+    float squared = 0.0f;
+    for (int a = 0; a < 3; a++)
+    {
+        const float min = spacing * c[a] * chunkCubes - cubeExtent;
+        const float max = spacing * (std::min((c[a] + 1) * chunkCubes, n[a]) - 1) + cubeExtent;
+        const float d = camera[a] < min ? min - camera[a] : camera[a] > max ? camera[a] - max : 0.0f;
+        squared += d * d;
+    }
+    return std::sqrt(squared);
+}
+
+unsigned long long chunkResidency::update(const glm::vec3& camera, unsigned long long drawnVersion, unsigned int maxLoads, std::vector<std::pair<unsigned int, unsigned int>>& loads) {
+    loads.clear();
+
+    // no draw reads slots evicted before the drawn version any more
+    for (size_t i = 0; i < retiredSlots.size();)
+    {
+        if (retiredSlots[i].second <= drawnVersion) {
+            freeSlots.push_back(retiredSlots[i].first);
+            retiredSlots[i] = retiredSlots.back();
+            retiredSlots.pop_back();
+        }
+        else {
+            i++;
+        }
+    }
+
+    bool changed = false;
+    for (size_t i = 0; i < residentChunks.size();)
+    {
+        const unsigned int chunk = residentChunks[i];
+        if (distance(chunk, camera) > evictRadius) {
+            // the slot is freed when the version without this chunk is drawn
+            retiredSlots.emplace_back(chunkSlot[chunk], version + 1);
+            chunkSlot[chunk] = -1;
+            residentChunks[i] = residentChunks.back();
+            residentChunks.pop_back();
+            changed = true;
+        }
+        else {
+            i++;
+        }
+    }
+
+    // missing chunks within the load radius, only chunks around the camera are visited
+    std::vector<std::pair<float, unsigned int>> missing;
+    const float chunkExtent = chunkCubes * spacing;
+    const int first[3] = {
+        std::max(0, int(std::floor((camera.x - loadRadius) / chunkExtent))),
+        std::max(0, int(std::floor((camera.y - loadRadius) / chunkExtent))),
+        std::max(0, int(std::floor((camera.z - loadRadius) / chunkExtent))) };
+    const int last[3] = {
+        std::min(int(chunksX) - 1, int(std::floor((camera.x + loadRadius) / chunkExtent)) + 1),
+        std::min(int(chunksY) - 1, int(std::floor((camera.y + loadRadius) / chunkExtent)) + 1),
+        std::min(int(chunksZ) - 1, int(std::floor((camera.z + loadRadius) / chunkExtent)) + 1) };
+    for (int z = first[2]; z <= last[2]; z++)
+    {
+        for (int y = first[1]; y <= last[1]; y++)
+        {
+            for (int x = first[0]; x <= last[0]; x++)
+            {
+                const unsigned int chunk = x + y * chunksX + z * chunksX * chunksY;
+                if (chunkSlot[chunk] >= 0)
+                    continue;
+                const float d = distance(chunk, camera);
+                if (d <= loadRadius)
+                    missing.emplace_back(d, chunk);
+            }
+        }
+    }
+
+    // nearest chunks are loaded first, the rest waits for the next update
+    std::sort(missing.begin(), missing.end());
+    for (size_t i = 0; i < missing.size() && loads.size() < maxLoads && !freeSlots.empty(); i++)
+    {
+        const unsigned int slot = freeSlots.back();
+        freeSlots.pop_back();
+        chunkSlot[missing[i].second] = int(slot);
+        slotChunk[slot] = missing[i].second;
+        residentChunks.push_back(missing[i].second);
+        loads.emplace_back(missing[i].second, slot);
+        changed = true;
+    }
+
+    if (changed)
+        version++;
+    return version;
+}
+
+const std::vector<unsigned int>& chunkResidency::resident() const {
+    return residentChunks;
+}
+
+int chunkResidency::slotOf(unsigned int chunk) const {
+    return chunkSlot[chunk];
+}
+
+size_t chunkResidency::chunkRuns(unsigned int chunk, std::vector<std::pair<size_t, size_t>>& runs) const {
+    const unsigned int x0 = chunk % chunksX * chunkCubes, y0 = chunk / chunksX % chunksY * chunkCubes, z0 = chunk / (chunksX * chunksY) * chunkCubes;
+    const unsigned int x1 = std::min(x0 + chunkCubes, nx), y1 = std::min(y0 + chunkCubes, ny), z1 = std::min(z0 + chunkCubes, nz);
+
+    runs.clear();
+    for (size_t z = z0; z < z1; z++)
+    {
+        for (size_t y = y0; y < y1; y++)
+            runs.emplace_back(x0 + (y + z * ny) * nx, x1 + (y + z * ny) * nx);
+    }
+    return size_t(x1 - x0) * (y1 - y0) * (z1 - z0);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <utility>
+#include "glm/glm.hpp"
+
+/// decides which chunks of a grid of cubes are resident in a fixed pool of slots around the camera
+/// chunks are loaded when they get closer than the load radius and evicted when they get farther than the evict radius,
+/// a slot of an evicted chunk is reused only after every draw that could read it has finished
+class chunkResidency
+{
+public:
+    /// cubes along each axis of a chunk
+    static const unsigned int chunkCubes = 8;
+
+protected:
+    /// cubes of the grid and chunks of the grid along each axis
+    unsigned int nx, ny, nz;
+    unsigned int chunksX, chunksY, chunksZ;
+    /// distance of centers of neighbouring cubes and distance of a cube face from its center
+    float spacing, cubeExtent;
+    float loadRadius, evictRadius;
+
+    /// slot of every chunk of the grid, -1 if the chunk is not resident
+    std::vector<int> chunkSlot;
+    /// chunk stored in every slot
+    std::vector<unsigned int> slotChunk;
+    std::vector<unsigned int> freeSlots;
+    /// slots of evicted chunks with the version of the resident set in which they were evicted
+    std::vector<std::pair<unsigned int, unsigned long long>> retiredSlots;
+    std::vector<unsigned int> residentChunks;
+    /// increased whenever the resident set changes
+    unsigned long long version = 0;
+
+    /// distance of the camera from the bounds of a chunk
+    float distance(unsigned int chunk, const glm::vec3& camera) const;
+
+public:
+    /// grid of nx, ny, nz cubes with cube x, y, z centered at spacing * (x, y, z), chunks are loaded within radius of the camera
+    chunkResidency(unsigned int nx, unsigned int ny, unsigned int nz, float spacing, float cubeExtent, float radius);
+
+    /// number of slots needed for every chunk within the evict radius of any camera position and for evicted chunks still being drawn
+    unsigned int slotCount() const;
+
+    /// frees slots evicted in versions up to drawnVersion, evicts far chunks and assigns free slots to at most maxLoads nearest chunks,
+    /// loads gets the chunks that have to be generated with their slots, returns the version of the new resident set
+    unsigned long long update(const glm::vec3& camera, unsigned long long drawnVersion, unsigned int maxLoads, std::vector<std::pair<unsigned int, unsigned int>>& loads);
+
+    const std::vector<unsigned int>& resident() const;
+
+    int slotOf(unsigned int chunk) const;
+
+    /// cubes of a chunk as ranges of cube indices, one range for every row of the chunk, returns the number of cubes
+    size_t chunkRuns(unsigned int chunk, std::vector<std::pair<size_t, size_t>>& runs) const;
+};
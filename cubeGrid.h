@@ -0,0 +1,397 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include "shapes.h"
+#include "simd.h"
+
+/// distance between neighbouring cubes of the grid
+static constexpr float cubeSpacing = 3.0f;
+
+/// packed vertices are stored relative to chunks of packedChunkCubes^3 cubes, so their positions fit to 16 bits
+static constexpr unsigned int packedChunkCubes = 32;
+static constexpr float packedChunkExtent = packedChunkCubes * cubeSpacing;
+static_assert((packedChunkExtent + 1.0f) * packedPositionScale <= 32767, "packed positions must fit to 16 bits");
+
+/// bits of faces of a cube centered at ox, oy, oz turned to the camera, in the order of cubeFaceTemplate
+/// a face is turned to the camera if the camera is in front of its plane, one unit from the center, margin keeps faces of planes the camera is about to cross
+inline unsigned int visibleCubeFaces(float ox, float oy, float oz, const GLfloat* camera, float margin) {
+    return unsigned(camera[0] > ox + 1.0f - margin)
+        | unsigned(camera[0] < ox - 1.0f + margin) << 1
+        | unsigned(camera[1] > oy + 1.0f - margin) << 2
+        | unsigned(camera[1] < oy - 1.0f + margin) << 3
+        | unsigned(camera[2] > oz + 1.0f - margin) << 4
+        | unsigned(camera[2] < oz - 1.0f + margin) << 5;
+}
+
+/// generator of a grid with dimensions known at compile time, NX cubes in a row, NY rows in a slab and NZ slabs
+/// strides are constants and the loop over cube vertices is unrolled, so every instantiation gets fully specialized code
+template <unsigned int NX, unsigned int NY, unsigned int NZ>
+struct CubeGrid {
+    static constexpr unsigned int nx = NX;
+    static constexpr unsigned int ny = NY;
+    static constexpr unsigned int nz = NZ;
+    static constexpr size_t cubeStride = cubeVertexCount * 8;
+    /// number of chunks of packed vertices along x and y
+    static constexpr unsigned int chunksX = (NX + packedChunkCubes - 1) / packedChunkCubes;
+    static constexpr unsigned int chunksY = (NY + packedChunkCubes - 1) / packedChunkCubes;
+
+    template <size_t... V>
+    static void writeCubeScalar(GLfloat* out, float ox, float oy, float oz, std::index_sequence<V...>) {
+        // one expansion per vertex, cubeVertexTemplate is a constant, so its values end in the instructions
+        int unrolled[] = { (
+            out[V * 8] = cubeVertexTemplate.data[V * 8] + ox,
+            out[V * 8 + 1] = cubeVertexTemplate.data[V * 8 + 1] + oy,
+            out[V * 8 + 2] = cubeVertexTemplate.data[V * 8 + 2] + oz,
+            out[V * 8 + 3] = cubeVertexTemplate.data[V * 8 + 3],
+            out[V * 8 + 4] = cubeVertexTemplate.data[V * 8 + 4],
+            out[V * 8 + 5] = cubeVertexTemplate.data[V * 8 + 5],
+            out[V * 8 + 6] = cubeVertexTemplate.data[V * 8 + 6],
+            out[V * 8 + 7] = cubeVertexTemplate.data[V * 8 + 7],
+            0)... };
+        (void)unrolled;
+    }
+
+    template <size_t... V>
+    static void writeCubeSSE(GLfloat* out, __m128 offset, std::index_sequence<V...>) {
+        // position with tex u are moved, tex v with normal are copied
+        int unrolled[] = { (
+            _mm_storeu_ps(out + V * 8, _mm_add_ps(_mm_loadu_ps(cubeVertexTemplate.data + V * 8), offset)),
+            _mm_storeu_ps(out + V * 8 + 4, _mm_loadu_ps(cubeVertexTemplate.data + V * 8 + 4)),
+            0)... };
+        (void)unrolled;
+    }
+
+    template <size_t... V>
+    PGR_TARGET_AVX static void writeCubeAVX(GLfloat* out, __m256 offset, std::index_sequence<V...>) {
+        int unrolled[] = { (
+            _mm256_storeu_ps(out + V * 8, _mm256_add_ps(_mm256_loadu_ps(cubeVertexTemplate.data + V * 8), offset)),
+            0)... };
+        (void)unrolled;
+    }
+
+    /// a cube is 18 whole cache lines, every line is assembled in registers and sent to memory by streaming stores,
+    /// so write-combined memory gets full lines and the data never goes through CPU caches, out must be aligned to 64 bytes
+    static_assert(cubeStride * sizeof(GLfloat) % 64 == 0, "cube must consist of whole cache lines");
+    static constexpr size_t cubeLines = cubeStride * sizeof(GLfloat) / 64;
+
+    template <size_t... L>
+    static void streamCubeSSE(GLfloat* out, __m128 offset, std::index_sequence<L...>) {
+        int unrolled[] = { (
+            streamLineSSE(out + L * 16, cubeVertexTemplate.data + L * 16, offset),
+            0)... };
+        (void)unrolled;
+    }
+
+    static void streamLineSSE(GLfloat* out, const GLfloat* vertices, __m128 offset) {
+        const __m128 a = _mm_add_ps(_mm_load_ps(vertices), offset);
+        const __m128 b = _mm_load_ps(vertices + 4);
+        const __m128 c = _mm_add_ps(_mm_load_ps(vertices + 8), offset);
+        const __m128 d = _mm_load_ps(vertices + 12);
+        _mm_stream_ps(out, a);
+        _mm_stream_ps(out + 4, b);
+        _mm_stream_ps(out + 8, c);
+        _mm_stream_ps(out + 12, d);
+    }
+
+    template <size_t... L>
+    PGR_TARGET_AVX static void streamCubeAVX(GLfloat* out, __m256 offset, std::index_sequence<L...>) {
+        int unrolled[] = { (
+            _mm256_stream_ps(out + L * 16, _mm256_add_ps(_mm256_load_ps(cubeVertexTemplate.data + L * 16), offset)),
+            _mm256_stream_ps(out + L * 16 + 8, _mm256_add_ps(_mm256_load_ps(cubeVertexTemplate.data + L * 16 + 8), offset)),
+            0)... };
+        (void)unrolled;
+    }
+
+    template <size_t... V>
+    static void writeFaceScalar(GLfloat* out, const GLfloat* face, float ox, float oy, float oz, std::index_sequence<V...>) {
+        int unrolled[] = { (
+            out[V * 8] = face[V * 8] + ox,
+            out[V * 8 + 1] = face[V * 8 + 1] + oy,
+            out[V * 8 + 2] = face[V * 8 + 2] + oz,
+            out[V * 8 + 3] = face[V * 8 + 3],
+            out[V * 8 + 4] = face[V * 8 + 4],
+            out[V * 8 + 5] = face[V * 8 + 5],
+            out[V * 8 + 6] = face[V * 8 + 6],
+            out[V * 8 + 7] = face[V * 8 + 7],
+            0)... };
+        (void)unrolled;
+    }
+
+    template <size_t... V>
+    static void writeFaceSSE(GLfloat* out, const GLfloat* face, __m128 offset, std::index_sequence<V...>) {
+        int unrolled[] = { (
+            _mm_storeu_ps(out + V * 8, _mm_add_ps(_mm_load_ps(face + V * 8), offset)),
+            _mm_storeu_ps(out + V * 8 + 4, _mm_load_ps(face + V * 8 + 4)),
+            0)... };
+        (void)unrolled;
+    }
+
+    template <size_t... V>
+    PGR_TARGET_AVX static void writeFaceAVX(GLfloat* out, const GLfloat* face, __m256 offset, std::index_sequence<V...>) {
+        int unrolled[] = { (
+            _mm256_storeu_ps(out + V * 8, _mm256_add_ps(_mm256_load_ps(face + V * 8), offset)),
+            0)... };
+        (void)unrolled;
+    }
+
+    template <size_t... V>
+    static void writeFacePacked(packedCubeVertex* out, const packedCubeVertex* face, GLshort ox, GLshort oy, GLshort oz, GLshort chunk, std::index_sequence<V...>) {
+        int unrolled[] = { (
+            out[V].position[0] = GLshort(face[V].position[0] + ox),
+            out[V].position[1] = GLshort(face[V].position[1] + oy),
+            out[V].position[2] = GLshort(face[V].position[2] + oz),
+            out[V].position[3] = chunk,
+            out[V].normal = face[V].normal,
+            0)... };
+        (void)unrolled;
+    }
+
+    template <size_t... V>
+    static void writeCubePacked(packedCubeVertex* out, GLshort ox, GLshort oy, GLshort oz, GLshort chunk, std::index_sequence<V...>) {
+        int unrolled[] = { (
+            out[V].position[0] = GLshort(packedCubeVertexTemplate.vertices[V].position[0] + ox),
+            out[V].position[1] = GLshort(packedCubeVertexTemplate.vertices[V].position[1] + oy),
+            out[V].position[2] = GLshort(packedCubeVertexTemplate.vertices[V].position[2] + oz),
+            out[V].position[3] = chunk,
+            out[V].normal = packedCubeVertexTemplate.vertices[V].normal,
+            0)... };
+        (void)unrolled;
+    }
+
+    /// fills cubes with indices from first to last, newCubes points to where the cube first is written
+    static void fillScalar(void* newCubes, size_t first, size_t last) {
+        GLfloat* cube = (GLfloat*)newCubes;
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++, cube += cubeStride)
+        {
+            writeCubeScalar(cube, cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, std::make_index_sequence<cubeVertexCount>());
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+    }
+
+    static void fillSSE(void* newCubes, size_t first, size_t last) {
+        GLfloat* cube = (GLfloat*)newCubes;
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++, cube += cubeStride)
+        {
+            // adding -0.0f keeps tex u bit-exact
+            const __m128 offset = _mm_setr_ps(cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, -0.0f);
+            writeCubeSSE(cube, offset, std::make_index_sequence<cubeVertexCount>());
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+    }
+
+    PGR_TARGET_AVX static void fillAVX(void* newCubes, size_t first, size_t last) {
+        GLfloat* cube = (GLfloat*)newCubes;
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++, cube += cubeStride)
+        {
+            // whole vertex is written by one store, adding -0.0f keeps tex coords and normal bit-exact (+0.0f would turn -0.0f into +0.0f)
+            const __m256 offset = _mm256_setr_ps(cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, -0.0f, -0.0f, -0.0f, -0.0f, -0.0f);
+            writeCubeAVX(cube, offset, std::make_index_sequence<cubeVertexCount>());
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+        _mm256_zeroupper();
+    }
+
+    /// the same as fillSSE, but with streaming stores, sfence at the end makes the data visible before unmapping or fencing
+    static void fillStreamSSE(void* newCubes, size_t first, size_t last) {
+        GLfloat* cube = (GLfloat*)newCubes;
+        if ((size_t)cube % 64 != 0) {
+            fillSSE(newCubes, first, last);
+            return;
+        }
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++, cube += cubeStride)
+        {
+            const __m128 offset = _mm_setr_ps(cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, -0.0f);
+            streamCubeSSE(cube, offset, std::make_index_sequence<cubeLines>());
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+        _mm_sfence();
+    }
+
+    PGR_TARGET_AVX static void fillStreamAVX(void* newCubes, size_t first, size_t last) {
+        GLfloat* cube = (GLfloat*)newCubes;
+        if ((size_t)cube % 64 != 0) {
+            fillAVX(newCubes, first, last);
+            return;
+        }
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++, cube += cubeStride)
+        {
+            const __m256 offset = _mm256_setr_ps(cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, -0.0f, -0.0f, -0.0f, -0.0f, -0.0f);
+            streamCubeAVX(cube, offset, std::make_index_sequence<cubeLines>());
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+        _mm_sfence();
+        _mm256_zeroupper();
+    }
+
+    /// writes one vertex in the center of every cube from first to last, for cubes drawn as point sprites
+    static void fillPoints(void* newCubes, size_t first, size_t last) {
+        GLfloat* out = (GLfloat*)newCubes;
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++, out += 8)
+        {
+            out[0] = cubeSpacing * x;
+            out[1] = cubeSpacing * y;
+            out[2] = cubeSpacing * z;
+            for (int j = 3; j < 8; j++)
+                out[j] = 0.0f;
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+    }
+
+    static void fillPointsPacked(void* newCubes, size_t first, size_t last) {
+        packedCubeVertex* out = (packedCubeVertex*)newCubes;
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++, out++)
+        {
+            out->position[0] = GLshort((x % packedChunkCubes) * cubeSpacing * packedPositionScale);
+            out->position[1] = GLshort((y % packedChunkCubes) * cubeSpacing * packedPositionScale);
+            out->position[2] = GLshort((z % packedChunkCubes) * cubeSpacing * packedPositionScale);
+            out->position[3] = GLshort(x / packedChunkCubes + (y / packedChunkCubes) * chunksX + (z / packedChunkCubes) * chunksX * chunksY);
+            out->normal = 0;
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+    }
+
+    /// fills cubes with indices from first to last with packed vertices
+    static void fillPacked(void* newCubes, size_t first, size_t last) {
+        packedCubeVertex* cube = (packedCubeVertex*)newCubes;
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++, cube += cubeVertexCount)
+        {
+            const GLshort chunk = GLshort(x / packedChunkCubes + (y / packedChunkCubes) * chunksX + (z / packedChunkCubes) * chunksX * chunksY);
+            writeCubePacked(cube,
+                GLshort((x % packedChunkCubes) * cubeSpacing * packedPositionScale),
+                GLshort((y % packedChunkCubes) * cubeSpacing * packedPositionScale),
+                GLshort((z % packedChunkCubes) * cubeSpacing * packedPositionScale),
+                chunk, std::make_index_sequence<cubeVertexCount>());
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+    }
+};
+
+/// face generators write only faces of cubes turned to the camera one after another from newCubes and return the number of written vertices
+template <unsigned int NX, unsigned int NY, unsigned int NZ>
+struct CubeFaces : CubeGrid<NX, NY, NZ> {
+    typedef CubeGrid<NX, NY, NZ> grid;
+
+    static size_t fillScalar(void* newCubes, size_t first, size_t last, const GLfloat* camera, float margin) {
+        GLfloat* out = (GLfloat*)newCubes;
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++)
+        {
+            const unsigned int faces = visibleCubeFaces(cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, camera, margin);
+            for (unsigned int f = 0; f < cubeFaceCount; f++)
+            {
+                if (faces & (1u << f)) {
+                    grid::writeFaceScalar(out, cubeVertexFaceTemplate.data[f], cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, std::make_index_sequence<faceVertexCount>());
+                    out += faceVertexCount * 8;
+                }
+            }
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+        return (out - (GLfloat*)newCubes) / 8;
+    }
+
+    static size_t fillSSE(void* newCubes, size_t first, size_t last, const GLfloat* camera, float margin) {
+        GLfloat* out = (GLfloat*)newCubes;
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++)
+        {
+            const unsigned int faces = visibleCubeFaces(cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, camera, margin);
+            const __m128 offset = _mm_setr_ps(cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, -0.0f);
+            for (unsigned int f = 0; f < cubeFaceCount; f++)
+            {
+                if (faces & (1u << f)) {
+                    grid::writeFaceSSE(out, cubeVertexFaceTemplate.data[f], offset, std::make_index_sequence<faceVertexCount>());
+                    out += faceVertexCount * 8;
+                }
+            }
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+        return (out - (GLfloat*)newCubes) / 8;
+    }
+
+    PGR_TARGET_AVX static size_t fillAVX(void* newCubes, size_t first, size_t last, const GLfloat* camera, float margin) {
+        GLfloat* out = (GLfloat*)newCubes;
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++)
+        {
+            const unsigned int faces = visibleCubeFaces(cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, camera, margin);
+            const __m256 offset = _mm256_setr_ps(cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, -0.0f, -0.0f, -0.0f, -0.0f, -0.0f);
+            for (unsigned int f = 0; f < cubeFaceCount; f++)
+            {
+                if (faces & (1u << f)) {
+                    grid::writeFaceAVX(out, cubeVertexFaceTemplate.data[f], offset, std::make_index_sequence<faceVertexCount>());
+                    out += faceVertexCount * 8;
+                }
+            }
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+        _mm256_zeroupper();
+        return (out - (GLfloat*)newCubes) / 8;
+    }
+
+    static size_t fillPacked(void* newCubes, size_t first, size_t last, const GLfloat* camera, float margin) {
+        packedCubeVertex* out = (packedCubeVertex*)newCubes;
+        size_t x = first % NX, y = first / NX % NY, z = first / (NX * NY);
+        for (size_t i = first; i < last; i++)
+        {
+            const unsigned int faces = visibleCubeFaces(cubeSpacing * x, cubeSpacing * y, cubeSpacing * z, camera, margin);
+            const GLshort chunk = GLshort(x / packedChunkCubes + (y / packedChunkCubes) * grid::chunksX + (z / packedChunkCubes) * grid::chunksX * grid::chunksY);
+            for (unsigned int f = 0; f < cubeFaceCount; f++)
+            {
+                if (faces & (1u << f)) {
+                    grid::writeFacePacked(out, cubeVertexFaceTemplate.packed[f],
+                        GLshort((x % packedChunkCubes) * cubeSpacing * packedPositionScale),
+                        GLshort((y % packedChunkCubes) * cubeSpacing * packedPositionScale),
+                        GLshort((z % packedChunkCubes) * cubeSpacing * packedPositionScale),
+                        chunk, std::make_index_sequence<faceVertexCount>());
+                    out += faceVertexCount;
+                }
+            }
+            if (++x == NX) { x = 0; if (++y == NY) { y = 0; z++; } }
+        }
+        return out - (packedCubeVertex*)newCubes;
+    }
+};
+
+/// one registered grid size with its generators indexed by simd::level, fillStream uses streaming stores (plain stores for scalar)
+struct cubeGridEntry {
+    unsigned int nx;
+    unsigned int ny;
+    unsigned int nz;
+    void (*fill[3])(void*, size_t, size_t);
+    void (*fillStream[3])(void*, size_t, size_t);
+    void (*fillPacked)(void*, size_t, size_t);
+    size_t (*fillFaces[3])(void*, size_t, size_t, const GLfloat*, float);
+    size_t (*fillFacesPacked)(void*, size_t, size_t, const GLfloat*, float);
+    void (*fillPoints)(void*, size_t, size_t);
+    void (*fillPointsPacked)(void*, size_t, size_t);
+};
+
+template <unsigned int NX, unsigned int NY, unsigned int NZ>
+constexpr cubeGridEntry makeCubeGridEntry() {
+    static_assert(CubeGrid<NX, NY, NZ>::chunksX * CubeGrid<NX, NY, NZ>::chunksY * ((NZ + packedChunkCubes - 1) / packedChunkCubes) <= 32767, "chunk index must fit to 16 bits");
+    return { NX, NY, NZ,
+        { CubeGrid<NX, NY, NZ>::fillScalar, CubeGrid<NX, NY, NZ>::fillSSE, CubeGrid<NX, NY, NZ>::fillAVX },
+        { CubeGrid<NX, NY, NZ>::fillScalar, CubeGrid<NX, NY, NZ>::fillStreamSSE, CubeGrid<NX, NY, NZ>::fillStreamAVX },
+        CubeGrid<NX, NY, NZ>::fillPacked,
+        { CubeFaces<NX, NY, NZ>::fillScalar, CubeFaces<NX, NY, NZ>::fillSSE, CubeFaces<NX, NY, NZ>::fillAVX },
+        CubeFaces<NX, NY, NZ>::fillPacked,
+        CubeGrid<NX, NY, NZ>::fillPoints,
+        CubeGrid<NX, NY, NZ>::fillPointsPacked };
+}
+
+/// grid sizes that can be selected at startup
+static const cubeGridEntry cubeGrids[] = {
+    makeCubeGridEntry<10, 10, 10>(),
+    makeCubeGridEntry<50, 50, 50>(),
+    makeCubeGridEntry<100, 100, 100>(),
+    makeCubeGridEntry<200, 200, 200>()
+};
+static const unsigned int nCubeGrids = sizeof(cubeGrids) / sizeof(cubeGrids[0]);
@@ -0,0 +1,93 @@
+#version 430 core
+
+// one invocation writes one cube: 36 vertices of 8 floats (position, tex coords, normal), the same layout as fillCubeArray
+layout (local_size_x = 64) in;
+
+// range of the cube buffer bound for this dispatch, the first cube of the dispatch starts at index 0
+layout (std430, binding = 0) writeonly buffer cubeBuffer {
+    float cubeData[];
+};
+
+// index of the first cube of the dispatch in the grid, number of cubes of the dispatch
+uniform uint firstCube;
+uniform uint cubeCount;
+// cubes along each axis of the grid and distance between neighbouring cubes
+uniform ivec3 grid;
+uniform float spacing;
+
+const vec3 cubeCorners[36] = vec3[36](
+    vec3(-1.0, -1.0, -1.0),
+    vec3(-1.0, -1.0, 1.0),
+    vec3(-1.0, 1.0, 1.0),
+    vec3(1.0, 1.0, -1.0),
+    vec3(-1.0, -1.0, -1.0),
+    vec3(-1.0, 1.0, -1.0),
+    vec3(1.0, -1.0, 1.0),
+    vec3(-1.0, -1.0, -1.0),
+    vec3(1.0, -1.0, -1.0),
+    vec3(1.0, 1.0, -1.0),
+    vec3(1.0, -1.0, -1.0),
+    vec3(-1.0, -1.0, -1.0),
+    vec3(-1.0, -1.0, -1.0),
+    vec3(-1.0, 1.0, 1.0),
+    vec3(-1.0, 1.0, -1.0),
+    vec3(1.0, -1.0, 1.0),
+    vec3(-1.0, -1.0, 1.0),
+    vec3(-1.0, -1.0, -1.0),
+    vec3(-1.0, 1.0, 1.0),
+    vec3(-1.0, -1.0, 1.0),
+    vec3(1.0, -1.0, 1.0),
+    vec3(1.0, 1.0, 1.0),
+    vec3(1.0, -1.0, -1.0),
+    vec3(1.0, 1.0, -1.0),
+    vec3(1.0, -1.0, -1.0),
+    vec3(1.0, 1.0, 1.0),
+    vec3(1.0, -1.0, 1.0),
+    vec3(1.0, 1.0, 1.0),
+    vec3(1.0, 1.0, -1.0),
+    vec3(-1.0, 1.0, -1.0),
+    vec3(1.0, 1.0, 1.0),
+    vec3(-1.0, 1.0, -1.0),
+    vec3(-1.0, 1.0, 1.0),
+    vec3(1.0, 1.0, 1.0),
+    vec3(-1.0, 1.0, 1.0),
+    vec3(1.0, -1.0, 1.0)
+);
+const vec3 cubeNormals[12] = vec3[12](
+    vec3(-1.0, 0.0, 0.0),
+    vec3(0.0, 0.0, -1.0),
+    vec3(0.0, -1.0, 0.0),
+    vec3(0.0, 0.0, -1.0),
+    vec3(-1.0, 0.0, 0.0),
+    vec3(0.0, -1.0, 0.0),
+    vec3(0.0, 0.0, 1.0),
+    vec3(1.0, 0.0, 0.0),
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= cubeCount)
+        return;
+
+    int cube = int(firstCube + i);
+    vec3 offset = vec3(cube % grid.x, (cube / grid.x) % grid.y, cube / (grid.x * grid.y)) * spacing;
+
+    uint base = i * 36u * 8u;
+    for (int v = 0; v < 36; v++) {
+        vec3 position = cubeCorners[v] + offset;
+        vec3 normal = cubeNormals[v / 3];
+        uint vertex = base + uint(v) * 8u;
+        cubeData[vertex] = position.x;
+        cubeData[vertex + 1u] = position.y;
+        cubeData[vertex + 2u] = position.z;
+        cubeData[vertex + 3u] = 0.0;
+        cubeData[vertex + 4u] = 0.0;
+        cubeData[vertex + 5u] = normal.x;
+        cubeData[vertex + 6u] = normal.y;
+        cubeData[vertex + 7u] = normal.z;
+    }
+}
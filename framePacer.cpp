@@ -0,0 +1,94 @@
+#include "framePacer.h"
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include <algorithm>
+
+// sleeping is at least this much shorter than the wait, the rest is spun
+static const double spinSeconds = 0.002;
+
+framePacer::framePacer(double budgetSeconds) : budget(budgetSeconds) {
+}
+
+void framePacer::setBudget(double budgetSeconds) {
+    budget = budgetSeconds;
+}
+
+bool framePacer::enabled() const {
+    return budget > 0.0;
+}
+
+double framePacer::now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void framePacer::waitUntil(double time) {
+    const double sleep = time - now() - spinSeconds;
+    if (sleep > 0.0)
+        std::this_thread::sleep_for(std::chrono::duration<double>(sleep));
+    while (now() < time)
+        std::this_thread::yield();
+}
+
+double framePacer::predictedPresent() const {
+    return frameStart.load() + budget;
+}
+
+unsigned long long framePacer::frame() const {
+    return startedFrames.load();
+}
+
+void framePacer::beginFrame() {
+    if (enabled()) {
+        // the first frame and frames after a missed deadline start at once
+        const double scheduled = frameStart.load() + budget;
+        const double current = now();
+        if (scheduled > current)
+            waitUntil(scheduled);
+        frameStart.store(std::max(scheduled, current));
+    }
+    startedFrames.increase();
+}
+
+void framePacer::endFrame() {
+    if (!enabled())
+        return;
+
+    const double delay = now() - predictedPresent();
+    checkedFrames++;
+    if (delay > 0.0) {
+        missedFrames++;
+        worstDelay = std::max(worstDelay, delay);
+    }
+}
+
+bool framePacer::waitForNextFrame(unsigned long long& frame, bool (*stop)()) {
+    if (!enabled())
+        return !stop();
+
+    // work finished after the next frame started or after the predicted present was not ready for its frame,
+    // work started before the first frame has no deadline
+    if (frame > 0 && (frame != startedFrames.load() || now() > predictedPresent()))
+        lateProducers++;
+    if (!startedFrames.waitFor(frame + 1, stop))
+        return false;
+    frame = startedFrames.load();
+    return true;
+}
+
+void framePacer::wake() {
+    startedFrames.wake();
+}
+
+void framePacer::report() {
+    if (!enabled())
+        return;
+
+    std::cout << "  missed deadlines: " << missedFrames << " of " << checkedFrames << " frames";
+    if (missedFrames > 0)
+        std::cout << ", worst " << worstDelay * 1000.0 << " ms late";
+    std::cout << ", late producer work: " << lateProducers.exchange(0) << std::endl;
+    checkedFrames = 0;
+    missedFrames = 0;
+    worstDelay = 0.0;
+}
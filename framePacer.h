@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include "waitableCounter.h"
+
+/// paces frames of the main thread to a fixed budget and lets producer threads do one unit of work per frame
+/// a frame starts one budget after the previous one and its present is predicted one budget after its start,
+/// a frame presented later missed its deadline and the next frame is scheduled from the time it was presented
+class framePacer
+{
+protected:
+    /// length of a frame in seconds, 0 when frames are not paced
+    double budget;
+    /// start of the current frame in seconds of steady_clock
+    std::atomic<double> frameStart{ 0.0 };
+    /// frames started, producers wait for it
+    waitableCounter startedFrames;
+
+    /// frames checked, frames presented after their deadline and the worst delay since the last report
+    unsigned long long checkedFrames = 0;
+    unsigned long long missedFrames = 0;
+    double worstDelay = 0.0;
+    /// units of producers finished after the predicted present of the frame they started in
+    std::atomic<unsigned long long> lateProducers{ 0 };
+
+public:
+    /// budgetSeconds 0 disables pacing, frames start at once and producers never wait
+    explicit framePacer(double budgetSeconds);
+
+    framePacer(const framePacer&) = delete;
+    framePacer& operator=(const framePacer&) = delete;
+
+    /// changes the budget, only before the first frame
+    void setBudget(double budgetSeconds);
+
+    bool enabled() const;
+
+    /// seconds of steady_clock the pacer schedules in
+    static double now();
+
+    /// sleeps until time, the last part is spun because the scheduler wakes sleeping threads late
+    static void waitUntil(double time);
+
+    /// predicted present of the current frame
+    double predictedPresent() const;
+
+    /// frames started so far, a producer starts with it
+    unsigned long long frame() const;
+
+    /// waits until the scheduled start of the next frame and lets producers do their work for it, called by the main thread
+    void beginFrame();
+
+    /// checks the deadline of the frame after its buffers were swapped, called by the main thread
+    void endFrame();
+
+    /// called by a producer after it finished its work for frame, waits until a later frame starts and stores it to frame
+    /// returns false if stop returned true first
+    bool waitForNextFrame(unsigned long long& frame, bool (*stop)());
+
+    /// wakes producers waiting for the next frame to check stop again
+    void wake();
+
+    /// prints missed deadlines since the last report, called by the main thread
+    void report();
+};
@@ -4,6 +4,7 @@
 #include "glm/gtx/transform.hpp"
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
+#include <vector>
 
 struct material {
     glm::vec3 ambient;
@@ -17,9 +18,12 @@ struct material {
 };
 
 struct modelGeometry {
-    GLuint elementBufferObject;
     GLuint vertexArrayObject;
     GLuint vertexBufferObject;
+    /// per-instance data of instanced models
+    GLuint instanceBufferObject;
+    /// draw commands of models drawn by indirect multi-draws
+    GLuint indirectBufferObject;
     unsigned int numTriangles;
     material meshMaterial;
 };
@@ -35,11 +39,20 @@ struct Handler {
 
 GLFWwindow* window;
 GLFWwindow* bufferContextWindow;
+/// contexts of threads filling parts of the cube ring together with the thread of bufferContextWindow (method 3)
+std::vector<GLFWwindow*> uploadContextWindows;
 GLFWwindow* textureContextWindow;
 
 
 /// program location for entities
 GLuint program;
+/// compute program generating cubes into the cube buffer, 0 if compute shaders are not supported
+GLuint computeProgram;
+/// uniform locations of the compute program
+GLint computeFirstCube;
+GLint computeCubeCount;
+GLint computeGrid;
+GLint computeSpacing;
 /// uniform locations for entities
 GLint pvmMatrix;
 GLint vmMatrix;
@@ -51,6 +64,18 @@ GLint position;
 GLint normal;
 /// uniform texture locations for entities
 GLint useEmissionTexture;
+/// uniform locations for decoding packed cube vertices
+GLint usePackedVertices;
+GLint packedChunkGrid;
+GLint packedChunkExtent;
+GLint packedPositionScale;
+/// uniform locations for cubes generated in the vertex shader
+GLint useProceduralCubes;
+GLint proceduralGrid;
+GLint proceduralSpacing;
+/// uniform locations for far cubes drawn as point sprites
+GLint useImpostors;
+GLint impostorPointScale;
 /// key maps for normal and special keys
 bool* keys;
 bool* specKeys;
@@ -64,8 +89,10 @@ int windowWidth;
 int windowHeight;
 
 // models
-static const unsigned char nModels = 2;
+static const unsigned char nModels = 4;
 modelGeometry models[nModels];
+/// vertex array object without any attributes, for geometry generated in shaders
+GLuint emptyVertexArrayObject;
 static const unsigned char nTextures = 6;
 unsigned char* textures[nTextures]; // in cpu memory
 GLuint GPUtextures[nTextures];      // in gpu memory
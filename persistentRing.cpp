@@ -0,0 +1,57 @@
+#include "persistentRing.h"
+
+// the mapping stays valid while draws read the buffer and written data are visible to them without flushing
+static const GLbitfield ringFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+persistentRing::persistentRing(size_t slotSize, unsigned int depth)
+    : bytesPerSlot(slotSize), slots(depth), readFences(depth, nullptr) {
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferStorage(GL_ARRAY_BUFFER, bytesPerSlot * slots, NULL, ringFlags);
+}
+
+persistentRing::~persistentRing() {
+    for (GLsync fence : readFences)
+    {
+        if (fence != nullptr)
+            glDeleteSync(fence);
+    }
+    if (mapped != nullptr)
+        unmap();
+    glDeleteBuffers(1, &buffer);
+}
+
+GLuint persistentRing::bufferObject() const {
+    return buffer;
+}
+
+size_t persistentRing::slotOffset(unsigned int slot) const {
+    return bytesPerSlot * slot;
+}
+
+void persistentRing::map() {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    mapped = (GLubyte*)glMapBufferRange(GL_ARRAY_BUFFER, 0, bytesPerSlot * slots, ringFlags);
+}
+
+void persistentRing::unmap() {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    mapped = nullptr;
+}
+
+void* persistentRing::acquire(unsigned int slot) {
+    if (readFences[slot] != nullptr) {
+        // the fence was flushed by the context that released the slot
+        glClientWaitSync(readFences[slot], 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(readFences[slot]);
+        readFences[slot] = nullptr;
+    }
+    return mapped + slotOffset(slot);
+}
+
+void persistentRing::release(unsigned int slot) {
+    if (readFences[slot] != nullptr)
+        glDeleteSync(readFences[slot]);
+    readFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
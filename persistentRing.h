@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include "glad/glad.h"
+
+/// buffer split to a ring of equally sized slots, the CPU writes one slot while draws read the others
+/// the storage is allocated once, map creates a persistent coherent mapping of the whole ring which is kept until unmap
+class persistentRing
+{
+protected:
+    GLuint buffer = 0;
+    size_t bytesPerSlot;
+    unsigned int slots;
+    /// whole ring while it is mapped, nullptr otherwise
+    GLubyte* mapped = nullptr;
+    /// signaled when draws reading a slot are finished, nullptr if no draw was released since the slot was acquired
+    std::vector<GLsync> readFences;
+
+public:
+    /// allocates depth slots of slotSize bytes, the buffer is left bound to GL_ARRAY_BUFFER
+    persistentRing(size_t slotSize, unsigned int depth);
+
+    ~persistentRing();
+
+    persistentRing(const persistentRing&) = delete;
+    persistentRing& operator=(const persistentRing&) = delete;
+
+    GLuint bufferObject() const;
+
+    size_t slotOffset(unsigned int slot) const;
+
+    /// maps the whole ring persistently and coherently, methods mapping parts of the buffer themselves need it unmapped
+    void map();
+
+    void unmap();
+
+    /// waits until the draws released for the slot are finished and returns its mapped memory, may be called from a shared context
+    void* acquire(unsigned int slot);
+
+    /// called after the draws reading the slot are issued, the slot can be acquired again when they are finished
+    void release(unsigned int slot);
+};
@@ -2,18 +2,43 @@
 #define _CRT_SECURE_NO_WARNINGS
 
 #include <iostream>
+#include <cstddef>
+// decoded images of textures are written straight to the texture store, see textureSinkMalloc
+void* textureSinkMalloc(size_t size);
+void* textureSinkRealloc(void* memory, size_t size);
+void textureSinkFree(void* memory);
+#define STBI_MALLOC(size) textureSinkMalloc(size)
+#define STBI_REALLOC(memory, size) textureSinkRealloc(memory, size)
+#define STBI_FREE(memory) textureSinkFree(memory)
 #include "stb_image.h"
 #include "handler.h"
 #include "camera.h"
+#include "cameraSnapshot.h"
+#include "framePacer.h"
 #include "shapes.h"
+#include "simd.h"
+#include "cubeGrid.h"
+#include "workerPool.h"
+#include "brickCuller.h"
+#include "chunkResidency.h"
+#include "persistentRing.h"
+#include "waitableCounter.h"
 #include <thread> 
 #include <mutex>
+#include <condition_variable>
 #define GLFW_INCLUDE_NONE
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
 #include "glm/gtc/type_ptr.hpp"
 #include <process.h>
 #include <chrono>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <cstdlib>
+#include <cerrno>
+#include <climits>
 
 
 struct Handler handler {};
@@ -73,6 +98,7 @@ namespace pgr {
             case GL_VERTEX_SHADER: strShaderType = "vertex";   break;
             case GL_FRAGMENT_SHADER: strShaderType = "fragment"; break;
             case GL_GEOMETRY_SHADER: strShaderType = "geometry"; break;
+            case GL_COMPUTE_SHADER: strShaderType = "compute"; break;
             }
 
             std::cerr << "Compile failure in " << strShaderType << " shader:" << std::endl;
@@ -165,24 +191,63 @@ bool changeTexture = false;
 bool endTextureMethod = false;
 
 constexpr unsigned int MS_PER_FRAME = 33;
+// frames of the main loop are paced only with -frame-budget, producers of vertices then do their work once per frame
+framePacer framePacing(0.0);
 
 camera cam;
 
-const unsigned int numberOfCubeSubbuffers = 3;
+// depth of the ring of cube buffer parts and number of parts filled ahead of the drawn one, chosen at startup
+unsigned int numberOfCubeSubbuffers = 3;
+// deepest ring accepted from the command line, fences and draw commands are kept for every part even with chunk streaming
+const unsigned int maxCubeRingDepth = 64;
+unsigned int numberOfCubesPreComputed = 1;
 std::thread bufferThread;
-bool bufferThreadEnd = false;
-
-std::mutex secondMethodMutexCamera;
-std::mutex secondMethodMutexData[numberOfCubeSubbuffers];
-std::mutex thidMethodMutex[numberOfCubeSubbuffers];
-GLsync thirdMethodSyncUploadStart[numberOfCubeSubbuffers];
-GLsync thirdMethodSyncUploadEnd[numberOfCubeSubbuffers];
+std::atomic<bool> bufferThreadEnd{ false };
+
+// camera after the last two simulation steps, drawing and culling read it without locks
+cameraSnapshot publishedCamera;
+// the scene is updated by simulationThread in steps of a fixed length, independently of drawing and streaming
+const double simulationStep = 1.0 / 120.0;
+std::thread simulationThread;
+// mouse movement not yet applied by a simulation step, added by the main thread after polling events
+// the fractional part stays here until it adds up to a whole pixel
+double mouseMovementX = 0.0;
+double mouseMovementY = 0.0;
+std::mutex mouseMovementMutex;
+// parts of the ring are handed between the main thread and the thread of methods 2-4 by two counters, no lock is held across threads
+// method 2: parts the main thread mapped for the other thread and parts the other thread filled
+// methods 3 and 4: parts the main thread drew and parts the other thread filled
+waitableCounter ringPartsReleased;
+waitableCounter ringPartsFilled;
+// fences of every part of the ring are sized by allocateCubeRingState
+std::vector<GLsync> thirdMethodSyncUploadStart;
+std::vector<GLsync> thirdMethodSyncUploadEnd;
+
+// number of contexts filling every part of the ring in method 3, each of them writes its own share of the cubes
+unsigned int uploadContexts = 1;
+// threads of the contexts other than bufferContextWindow
+std::vector<std::thread> uploadHelpers;
+// fences of the shares of helpers, uploadContexts - 1 for every part of the ring
+std::vector<GLsync> helperSyncUploadEnd;
+// shares of a part are handed to helpers by increasing uploadJobs and returned by increasing uploadSharesDone
+waitableCounter uploadJobs;
+waitableCounter uploadSharesDone;
+// part filled by the last job, cubes of the ranges are split to uploadContexts shares
+void* uploadJobPointer = nullptr;
+unsigned int uploadJobIndex = 0;
+std::vector<std::pair<size_t, size_t>> uploadJobRuns;
+size_t uploadJobCubes = 0;
 
 unsigned char bufferMethod = 0;
 bool bufferMethod2Updated = false;
 
 bool bufferMapped = false;
-bool end = false;
+std::atomic<bool> end{ false };
+
+// the thread of a vertex method stops when the method is changed or the application ends
+bool vertexThreadStopping() {
+    return end || bufferThreadEnd;
+}
 
 bool useAsynchTextures = false;
 bool textureLoaded[handler.nTextures];
@@ -196,34 +261,229 @@ bool firstTextureLoaded = false;
 GLsync endUpload[handler.nTextures];
 std::thread textureThread;
 bool textureThreadRunning = false;
-GLuint pbo[2];
-unsigned int curPBO = 0;
-
-GLfloat* cubesMappedPointer;
+// pixel unpack buffer with a ring of textureRingSlots slots, persistently mapped to handler.textures
+// textures are decoded straight into the slots and uploaded from them, no copy of them is kept on the heap
+GLuint textureStore = 0;
+GLubyte* textureStorePointer = nullptr;
+// distance of slots, a slot has room for the largest RGB image and the byte the decoder allocates after it
+size_t textureSlotSize = 0;
+// with fewer slots than textures, textureDecodeThread decodes the following textures into the slots in rotation, option -texture-ring
+unsigned int textureRingSlots = handler.nTextures;
+// texture decoded in every slot (-1 for none), whether it was uploaded since and the fence of its last upload
+// a slot is decoded into again only after its texture was uploaded and the fence is signaled, guarded by textureRingMutex
+int textureInSlot[handler.nTextures];
+bool textureSlotUploaded[handler.nTextures];
+GLsync textureSlotFence[handler.nTextures];
+std::mutex textureRingMutex;
+std::condition_variable textureSlotReleased;
+std::thread textureDecodeThread;
+bool uploadTextureFromRing(unsigned int i);
+
+void* cubesMappedPointer;
+// index of the part of the buffer cubesMappedPointer points to
+unsigned int cubesMappedIndex = 0;
 const unsigned int cubeSize = sizeof(cubeVertices);
 const unsigned int nCubeTriangles = cubeSize / 3 / sizeof(GLfloat);
-const unsigned int nCubesRow = 100;
-const unsigned int nCubesCol = 100;
-const unsigned int nCubesDepth = 100;
-const float diff = 3.0f;
-const unsigned int cubesSize = nCubeTriangles * nCubesRow * nCubesCol * nCubesDepth;
+// size of the cube grid, chosen at startup from the registered grids in cubeGrid.h
+unsigned int cubeGridSize = 100;
+unsigned int nCubesRow = 100;
+unsigned int nCubesCol = 100;
+unsigned int nCubesDepth = 100;
+unsigned int nCubes = nCubesRow * nCubesCol * nCubesDepth;
+unsigned int cubesSize = nCubeTriangles * nCubes;
+// highest instruction set the generators may use, lowered from the command line to compare generators
+simd::level maxSimdLevel = simd::avx;
+// use fillCubeArrayScalar instead of the specialized generators
+bool useReferenceFiller = false;
+// cube vertices of methods 0-3 are stored as packedCubeVertex instead of 8 floats
+bool packedVertices = false;
+// vectorized generators write whole cache lines with streaming stores, which bypass CPU caches
+bool streamingStores = true;
+// compares streaming and plain stores at startup and ends the application
+bool benchmarkStores = false;
+
+// size of one cube vertex in the buffer of methods 0-3
+size_t cubeVertexSize() {
+    return packedVertices ? sizeof(packedCubeVertex) : 8 * sizeof(GLfloat);
+}
 
-unsigned int numberOfCubesPreComputed = 1;
-GLuint* cubesIndices;
+// size of one part of the buffer of cube vertices of methods 0-3
+size_t cubeSubbufferSize() {
+    return cubeVertexSize() * cubesSize;
+}
 
-unsigned int cubeDrawingIndex = numberOfCubeSubbuffers - 1;
+// vertices of methods 0-3 and 6, method 3 writes them through a persistent mapping of the ring
+persistentRing* cubeRing = nullptr;
+// largest ring of cube vertices allocated, larger grids are only drawn with chunk streaming
+const size_t maxCubeRingBytes = size_t(8) << 30;
+
+unsigned int cubeDrawingIndex = 0;
+
+// generator selected at startup according to the instruction sets the CPU supports, fills cubes from first to last
+void (*cubeArrayFiller)(void*, size_t, size_t);
+
+// number of threads generating cube slabs in parallel, 1 generates them on the calling thread, 0 uses every core
+unsigned int fillThreads = 1;
+workerPool* fillPool = nullptr;
+// time spent on every z-slab since the last report
+std::mutex slabTimesMutex;
+std::vector<double> slabTimes;
+std::vector<unsigned int> slabSamples;
+
+void fillCubeArray(void*);
+void fillCubeInstances(GLfloat*, unsigned int);
+void fillCubeSubbuffer(void*, unsigned int, bool);
+void fillCubeSubbufferShared(void*, unsigned int);
+void stopUploadHelpers();
+GLbitfield cubeMapFlags(GLbitfield);
+size_t cullCubes();
+
+// only cubes changed since a part of the buffer was filled are rewritten (methods 0-3)
+bool incrementalUpdates = false;
+// fraction of cubes changed in every scene update when incremental updates are used
+double changedCubesFraction = 0.001;
+// ranges of cubes changed since each part of the buffer was filled
+std::mutex dirtyCubesMutex;
+std::vector<std::vector<std::pair<size_t, size_t>>> dirtyCubes;
+// a part of the buffer with more changed ranges is rewritten whole, so parts that are not filled do not collect ranges forever
+const size_t maxDirtyRanges = 1 << 16;
+
+// only cubes in bricks inside the view frustum are generated and uploaded (methods 0-4)
+bool frustumCulling = false;
+// created after the first cubes are generated, they are generated whole because the size of the window is not known yet
+brickCuller* culler = nullptr;
+// bricks are enlarged by this distance, so cubes culled with an older camera do not disappear at the edges of the screen
+const float cullingMargin = 2 * cubeSpacing;
+// ranges of indices of visible cubes found by the last cull
+std::vector<std::pair<size_t, size_t>> visibleCubeRuns;
+// number of cubes written to each part of the buffer, all of them without frustum culling
+std::vector<size_t> subbufferCubes;
+// number of vertices written to each part of the buffer of methods 0-3, less than the vertices of all written cubes if only visible faces are written
+std::vector<size_t> subbufferVertices;
+
+// only faces of cubes turned to the camera are generated and uploaded (methods 0-3)
+bool visibleFacesOnly = false;
+// generator writing only visible faces, selected together with cubeArrayFiller
+size_t (*cubeFaceFiller)(void*, size_t, size_t, const GLfloat*, float);
+// faces are kept when the camera is closer than this to their plane, so they do not disappear when the camera moves before drawing
+const float faceMargin = cubeSpacing;
+
+// cubes farther than impostorDistance from the camera are drawn as point sprites and cubes farther than lodDropDistance are not drawn (methods 0-3)
+// 0 draws every cube with full geometry
+float impostorDistance = 0.0f;
+float lodDropDistance = 200.0f;
+// generator of one vertex in the center of every cube, selected together with cubeArrayFiller
+void (*cubePointFiller)(void*, size_t, size_t);
+// ranges of indices of cubes drawn as point sprites found by the last split by distance
+std::vector<std::pair<size_t, size_t>> impostorCubeRuns;
+// number of point sprites at the end of each part of the buffer and of cubes too far to be drawn
+std::vector<size_t> subbufferImpostors;
+std::vector<size_t> subbufferDroppedCubes;
+
+// cubes are streamed in chunks around the camera into a bounded pool of chunk slots (method 7), 0 keeps the whole grid in the buffer of methods 0-3
+float chunkStreamingRadius = 0.0f;
+chunkResidency* residency = nullptr;
+// at most this many chunks are generated in one update of the resident set, the nearest first
+const unsigned int chunkLoadsPerUpdate = 32;
+// the pool of chunk slots is mapped once for the whole run
+void* chunkPoolPointer = nullptr;
+
+// resident chunks published by the streaming thread, one range of vertices for every chunk
+struct chunkDrawList {
+    std::vector<unsigned int> chunks;
+    std::vector<GLint> firsts;
+    std::vector<GLsizei> counts;
+    // version of the resident set
+    unsigned long long version = 0;
+    // signaled when the chunks of this version are written
+    GLsync uploaded = nullptr;
+};
+std::mutex chunkDrawListMutex;
+std::condition_variable chunkDrawnCondition;
+chunkDrawList publishedChunks;
+bool chunkListPublished = false;
+// list drawn by the main thread
+chunkDrawList drawnChunks;
+// fence of the last draw and the version it drew, slots evicted before this version are reused when it is signaled
+GLsync chunkDrawnFence = nullptr;
+unsigned long long chunkDrawnVersion = 0;
+
+// layout of one command of glMultiDrawArraysIndirect
+struct drawArraysIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+// chunks are bricks of the frustum culler, so resident chunks are culled by the bricks found visible
+static_assert(brickCuller::brickCubes == chunkResidency::chunkCubes, "chunks have to match bricks of the culler");
+// commands of resident chunks in the view frustum, every frame writes the next of numberOfCubeSubbuffers parts of the indirect buffer
+drawArraysIndirectCommand* chunkCommandsPointer = nullptr;
+unsigned int chunkCommandsIndex = 0;
+// signaled when the GPU has read the commands of a part
+std::vector<GLsync> chunkCommandsFence;
+// number of chunks drawn in the last frame
+size_t chunkCommandsDrawn = 0;
+
+// size of one chunk slot, every chunk takes the same space even if it is cut by the end of the grid
+size_t chunkSlotSize() {
+    return cubeVertexSize() * nCubeTriangles * chunkResidency::chunkCubes * chunkResidency::chunkCubes * chunkResidency::chunkCubes;
+}
 
-void fillCubeArray(GLfloat*);
+// size of one part of the buffer of cube offsets used by instanced drawing (method 4)
+size_t instanceSubbufferSize() {
+    return sizeof(GLfloat) * 3 * nCubes;
+}
 
-void updateCommonUniforms(int i) {
-    glm::mat4 projection = glm::perspectiveFov(70.0f, float(handler.windowWidth), float(handler.windowHeight), 1.0f, 200.0f);
+// sizes the state kept for every part of the ring after its depth is known
+void allocateCubeRingState() {
+    thirdMethodSyncUploadStart.assign(numberOfCubeSubbuffers, nullptr);
+    thirdMethodSyncUploadEnd.assign(numberOfCubeSubbuffers, nullptr);
+    helperSyncUploadEnd.assign(numberOfCubeSubbuffers * (uploadContexts - 1), nullptr);
+    dirtyCubes.assign(numberOfCubeSubbuffers, {});
+    subbufferCubes.assign(numberOfCubeSubbuffers, 0);
+    subbufferVertices.assign(numberOfCubeSubbuffers, 0);
+    subbufferImpostors.assign(numberOfCubeSubbuffers, 0);
+    subbufferDroppedCubes.assign(numberOfCubeSubbuffers, 0);
+    chunkCommandsFence.assign(numberOfCubeSubbuffers, nullptr);
+    cubeDrawingIndex = numberOfCubeSubbuffers - 1;
+}
+
+// cubes along each axis of the grid generated in the vertex shader (method 5), 0 uses the size of the cube grid
+unsigned int proceduralGridSize = 0;
+
+// tells the vertex shader if vertices are packed or generated from gl_VertexID
+void setVertexSourceUniforms(bool packed, bool procedural) {
+    glUniform1i(handler.usePackedVertices, packed);
+    glUniform1i(handler.useProceduralCubes, procedural);
+}
+
+// width / height of the framebuffer published by the main thread, threads of methods 2-4 cull with the projection while the window is resized
+std::atomic<float> viewAspect{ 640.0f / 480.0f };
+
+glm::mat4 cameraProjection() {
+    // the projection depends only on the ratio of the sizes
+    return glm::perspectiveFov(70.0f, viewAspect.load(), 1.0f, 1.0f, 200.0f);
+}
+
+glm::mat4 stateView(const cameraState& state) {
+    return glm::lookAt(state.position, state.position + state.direction, state.upVector);
+}
+
+// the simulation thread updates the camera while it is read, so the last published state is used
+glm::mat4 cameraView() {
+    return stateView(publishedCamera.read());
+}
 
+// drawn camera moves smoothly between simulation steps, it is one step behind the simulation
+glm::mat4 renderCameraView() {
+    return stateView(publishedCamera.interpolate(glfwGetTime(), simulationStep));
+}
 
-    secondMethodMutexCamera.lock();
-    glm::mat4 view = glm::lookAt(cam.getPosition(), cam.getPosition() + cam.getDirection(), cam.getUpVector());
-    secondMethodMutexCamera.unlock();
+void setMatrixUniforms(const glm::mat4& modelMatrix) {
+    glm::mat4 projection = cameraProjection();
+    glm::mat4 view = renderCameraView();
 
-    glm::mat4 modelMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(5.0f)) + glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, -i * 15.0f));
     glUseProgram(handler.program);
     glm::mat4 pvm = projection * view * modelMatrix;
     CHECK_GL_ERROR();
@@ -239,6 +499,30 @@ void updateCommonUniforms(int i) {
     CHECK_GL_ERROR();
 }
 
+void updateCommonUniforms(int i) {
+    setMatrixUniforms(glm::scale(glm::mat4(1.0f), glm::vec3(5.0f)) + glm::translate(glm::mat4(1.0f), glm::vec3(0, 0, -i * 15.0f)));
+}
+
+// cubes are generated in world coordinates, the same camera is used to cull them
+void updateCubeUniforms() {
+    setMatrixUniforms(glm::mat4(1.0f));
+    // a cube 2 units wide is cameraProjection()[1][1] * windowHeight / w pixels high on the screen
+    glUniform1f(handler.impostorPointScale, cameraProjection()[1][1] * handler.windowHeight);
+}
+
+// draws cubes of the part of the cube buffer with index "index" (methods 0-3 and 6)
+void drawCubeSubbuffer(unsigned int index) {
+    // vertices of cubes are never shared, so they are drawn without indices
+    glDrawArrays(GL_TRIANGLES, GLint(cubesSize * index), GLsizei(subbufferVertices[index]));
+
+    // point sprites of far cubes are at the end of the part of the buffer
+    if (subbufferImpostors[index] > 0) {
+        glUniform1i(handler.useImpostors, 1);
+        glDrawArrays(GL_POINTS, GLint(cubesSize * (index + 1) - subbufferImpostors[index]), GLsizei(subbufferImpostors[index]));
+        glUniform1i(handler.useImpostors, 0);
+    }
+}
+
 
 void drawSquareAsync() {
     CHECK_GL_ERROR();
@@ -254,6 +538,7 @@ void drawSquareAsync() {
 
         // set a uniform that tells if we use texture
         glUniform1i(handler.useEmissionTexture, 1);
+        setVertexSourceUniforms(false, false);
 
         // begin timing
         glBeginQuery(GL_TIME_ELAPSED, textureQueries[thisFrameIndex++]);
@@ -298,15 +583,19 @@ void drawSquare() {
 
         // set a uniform that tells if we use texture
         glUniform1i(handler.useEmissionTexture, 1);
+        setVertexSourceUniforms(false, false);
         CHECK_GL_ERROR();
 
         // begin timing
         glBeginQuery(GL_TIME_ELAPSED, textureQueries[thisFrameIndex++]);
         CHECK_GL_ERROR();
 
-        // bind a texture to the spot and copy data to it from CPU
+        // copy data to the texture from its slot of the texture ring and bind it to the spot
+        // a texture that is not decoded in the ring yet is drawn with its last content
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, textureStore);
+        uploadTextureFromRing(i);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
         glBindTexture(GL_TEXTURE_2D, handler.GPUtextures[i]);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, handler.widths[0], handler.heights[0], GL_RGB, GL_UNSIGNED_BYTE, handler.textures[i]);
         CHECK_GL_ERROR();
    
         // draw texture
@@ -320,34 +609,35 @@ void drawSquare() {
 }
 
 void drawCubesMethod2() {
-    glUseProgram(handler.program);
+    updateCubeUniforms();
 
     // set a uniform that tells if we use texture
     glUniform1i(handler.useEmissionTexture, 0);
+    // set uniforms that tell where vertices come from, instanced cubes use the float mesh
+    setVertexSourceUniforms(packedVertices && bufferMethod != 4, false);
 
     // begin timing
     glFlush();
     glBeginQuery(GL_TIME_ELAPSED, vertexQueries[thisFrameIndex++]);
     glFlush();
 
-    // unlock second thread to start copying data to the part of a buffer that was drawn in the last iteration
-    secondMethodMutexData[cubeDrawingIndex].unlock();
+    // wait until the other thread fills the mapped part of the buffer
+    const unsigned long long mapped = ringPartsReleased.load();
+    ringPartsFilled.waitFor(mapped, vertexThreadStopping);
+    cubeDrawingIndex = cubesMappedIndex;
 
-    // increase index of part of buffer we are drawing
-    cubeDrawingIndex = (cubeDrawingIndex + 1) % numberOfCubeSubbuffers;
-    // lock part of the buffer that is going to be drawn
-    secondMethodMutexData[cubeDrawingIndex].lock();
-    
-    // unmap part of the buffer to which were data copied in the last iteration
+    // unmap part of the buffer to which were data copied
     glUnmapBuffer(GL_ARRAY_BUFFER);
     CHECK_GL_ERROR();
-    
-    // map new part of the buffer for the other thread copies data
-    cubesMappedPointer = (GLfloat*)glMapBufferRange(GL_ARRAY_BUFFER, sizeof(GLfloat) * cubesSize * 8 * ((cubeDrawingIndex - numberOfCubesPreComputed + numberOfCubeSubbuffers) % numberOfCubeSubbuffers), sizeof(GLfloat) * cubesSize * 8, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
+
+    // map the next part of the buffer, the other thread takes the pointer when the counter is increased
+    cubesMappedIndex = mapped % numberOfCubeSubbuffers;
+    cubesMappedPointer = glMapBufferRange(GL_ARRAY_BUFFER, cubeSubbufferSize() * cubesMappedIndex, cubeSubbufferSize(), GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
     CHECK_GL_ERROR();
-    
+    ringPartsReleased.increase();
+
     // draw some cubes
-    glDrawElements(GL_TRIANGLES, 3003, GL_UNSIGNED_INT, (const void*)(handler.models[1].elementBufferObject + cubesSize * cubeDrawingIndex * sizeof(GLuint)));
+    drawCubeSubbuffer(cubeDrawingIndex);
     CHECK_GL_ERROR();
 
     // end timing
@@ -360,35 +650,54 @@ void drawCubesMethod2() {
 
 void drawCubesMethod3() {
 
-    glUseProgram(handler.program);
+    updateCubeUniforms();
 
     // set a uniform that tells if we use texture
     glUniform1i(handler.useEmissionTexture, 0);
+    // set uniforms that tell where vertices come from, instanced cubes use the float mesh
+    setVertexSourceUniforms(packedVertices && bufferMethod != 4, false);
 
     // begin timing
     glFlush();
     glBeginQuery(GL_TIME_ELAPSED, vertexQueries[thisFrameIndex++]);
     glFlush();
 
-
-
-    // unlock second thread to start mapping and copying data to the part of a buffer that was drawn in the last iteration
-    thidMethodMutex[cubeDrawingIndex].unlock();
-    // increase index of part of buffer we are drawing
-    cubeDrawingIndex = (cubeDrawingIndex + 1) % numberOfCubeSubbuffers;
-
-    // lock part of the buffer that is going to be drawns
-    thidMethodMutex[cubeDrawingIndex].lock();
+    // wait until the other thread fills the next part of the buffer, parts are drawn in the order they are filled
+    const unsigned long long part = ringPartsReleased.load();
+    ringPartsFilled.waitFor(part + 1, vertexThreadStopping);
+    cubeDrawingIndex = part % numberOfCubeSubbuffers;
 
     // wait for all previous openGL commands end(copying from other thread)
-    glWaitSync(thirdMethodSyncUploadEnd[cubeDrawingIndex], 0, GL_TIMEOUT_IGNORED);
-    glDeleteSync(thirdMethodSyncUploadEnd[cubeDrawingIndex]);
+    if (thirdMethodSyncUploadEnd[cubeDrawingIndex] != nullptr) {
+        glWaitSync(thirdMethodSyncUploadEnd[cubeDrawingIndex], 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(thirdMethodSyncUploadEnd[cubeDrawingIndex]);
+        thirdMethodSyncUploadEnd[cubeDrawingIndex] = nullptr;
+    }
+    // and for the shares written in the contexts of helpers
+    for (unsigned int i = 0; i + 1 < uploadContexts && bufferMethod == 3; i++)
+    {
+        GLsync& fence = helperSyncUploadEnd[cubeDrawingIndex * (uploadContexts - 1) + i];
+        if (fence != nullptr) {
+            glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
 
     // draw some cubes
-    glDrawElements(GL_TRIANGLES, 3003, GL_UNSIGNED_INT, (const void*)(handler.models[1].elementBufferObject + cubesSize * cubeDrawingIndex * sizeof(GLuint)));
+    if (bufferMethod == 4)
+        // one cube mesh for every offset in the part of the buffer, base instance selects the part
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, nCubeTriangles, GLsizei(subbufferCubes[cubeDrawingIndex]), nCubes * cubeDrawingIndex);
+    else
+        drawCubeSubbuffer(cubeDrawingIndex);
 
     // create an openGL sync object for the other thread to recognize when this thread stopped drawing
-    thirdMethodSyncUploadStart[cubeDrawingIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    if (bufferMethod == 4)
+        thirdMethodSyncUploadStart[cubeDrawingIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    else
+        cubeRing->release(cubeDrawingIndex);
+    // the other thread may fill the part again when the fence is signaled
+    ringPartsReleased.increase();
     
     // end timing
     glFlush();
@@ -400,10 +709,12 @@ void drawCubesMethod3() {
 
 void drawCubes() {
 
-    glUseProgram(handler.program);
+    updateCubeUniforms();
 
     // set a uniform that tells if we use texture
     glUniform1i(handler.useEmissionTexture, 0);
+    // set uniforms that tell where vertices come from, instanced cubes use the float mesh
+    setVertexSourceUniforms(packedVertices && bufferMethod != 4, false);
 
     // begin timing
     glFlush();
@@ -414,7 +725,7 @@ void drawCubes() {
     cubeDrawingIndex = (cubeDrawingIndex + 1) % numberOfCubeSubbuffers;
 
     // set flags for mapping a part of the buffer
-    unsigned char flags = GL_MAP_WRITE_BIT;
+    GLbitfield flags = GL_MAP_WRITE_BIT;
     if (bufferMethod == 1)
         flags |= GL_MAP_UNSYNCHRONIZED_BIT;
     
@@ -422,17 +733,18 @@ void drawCubes() {
     glBindBuffer(GL_ARRAY_BUFFER, handler.models[1].vertexBufferObject);
 
     // map part of the buffer
-    GLfloat* ptr = (GLfloat*)glMapBufferRange(GL_ARRAY_BUFFER, sizeof(GLfloat) * cubesSize * 8 * ((cubeDrawingIndex - numberOfCubesPreComputed + numberOfCubeSubbuffers) % numberOfCubeSubbuffers), sizeof(GLfloat) * cubesSize * 8, flags);
+    const unsigned int fillIndex = (cubeDrawingIndex - numberOfCubesPreComputed + numberOfCubeSubbuffers) % numberOfCubeSubbuffers;
+    void* ptr = glMapBufferRange(GL_ARRAY_BUFFER, cubeSubbufferSize() * fillIndex, cubeSubbufferSize(), cubeMapFlags(flags));
     CHECK_GL_ERROR();
     
     // fill the mapped buffer with cube data
-    fillCubeArray(ptr);
+    fillCubeSubbuffer(ptr, fillIndex, true);
 
     // unmap buffer
     glUnmapBuffer(GL_ARRAY_BUFFER);
 
     // draw some cubes
-    glDrawElements(GL_TRIANGLES, 3003, GL_UNSIGNED_INT, (const void*)(handler.models[1].elementBufferObject + cubesSize * cubeDrawingIndex * sizeof(GLuint)));
+    drawCubeSubbuffer(cubeDrawingIndex);
     
     // end timing
     glFlush();
@@ -443,6 +755,174 @@ void drawCubes() {
 }
 
 
+// draws cubes generated in the vertex shader, nothing is uploaded
+void drawCubesProcedural() {
+    updateCubeUniforms();
+
+    // set a uniform that tells if we use texture
+    glUniform1i(handler.useEmissionTexture, 0);
+    setVertexSourceUniforms(false, true);
+
+    // begin timing
+    glFlush();
+    glBeginQuery(GL_TIME_ELAPSED, vertexQueries[thisFrameIndex++]);
+    glFlush();
+
+    const unsigned int gridSize = proceduralGridSize ? proceduralGridSize : nCubesCol;
+    glUniform3i(handler.proceduralGrid, gridSize, gridSize, gridSize);
+    glUniform1f(handler.proceduralSpacing, cubeSpacing);
+
+    // cube, corner and normal are computed from gl_VertexID
+    glDrawArrays(GL_TRIANGLES, 0, GLsizei(nCubeTriangles * gridSize * gridSize * gridSize));
+
+    // end timing
+    glFlush();
+    glEndQuery(GL_TIME_ELAPSED);
+    glFlush();
+
+    CHECK_GL_ERROR();
+}
+
+// fills a part of the cube buffer with the compute program, the same data as fillCubeArray writes
+void computeCubeSubbuffer(unsigned int index) {
+    glUseProgram(handler.computeProgram);
+    glUniform3i(handler.computeGrid, nCubesCol, nCubesRow, nCubesDepth);
+    glUniform1f(handler.computeSpacing, cubeSpacing);
+
+    // a part of the buffer is larger than a shader storage block may be, so it is bound in batches of whole work groups
+    GLint maxBlockSize;
+    glGetIntegerv(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+    const size_t cubeBytes = 8 * sizeof(GLfloat) * nCubeTriangles;
+    size_t batchCubes = std::min((size_t)maxBlockSize / cubeBytes, (size_t)65535 * 64);
+    batchCubes -= batchCubes % 64;
+
+    for (size_t first = 0; first < nCubes; first += batchCubes)
+    {
+        const size_t count = std::min(batchCubes, nCubes - first);
+        // batches are multiples of 64 cubes, so their offsets keep GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, handler.models[1].vertexBufferObject, cubeSubbufferSize() * index + first * cubeBytes, count * cubeBytes);
+        glUniform1ui(handler.computeFirstCube, GLuint(first));
+        glUniform1ui(handler.computeCubeCount, GLuint(count));
+        glDispatchCompute(GLuint((count + 63) / 64), 1, 1);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+
+    subbufferCubes[index] = nCubes;
+    subbufferVertices[index] = cubesSize;
+    subbufferImpostors[index] = 0;
+
+    // vertex fetches of following draws have to see the data written by the compute program
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    glUseProgram(handler.program);
+    CHECK_GL_ERROR();
+}
+
+// cubes are generated on GPU into the part of the buffer the CPU methods would fill, then drawn
+void drawCubesCompute() {
+    updateCubeUniforms();
+
+    // set a uniform that tells if we use texture
+    glUniform1i(handler.useEmissionTexture, 0);
+    setVertexSourceUniforms(false, false);
+
+    // begin timing
+    glFlush();
+    glBeginQuery(GL_TIME_ELAPSED, vertexQueries[thisFrameIndex++]);
+    glFlush();
+
+    // update drawing index
+    cubeDrawingIndex = (cubeDrawingIndex + 1) % numberOfCubeSubbuffers;
+
+    // generate cubes to the same part of the buffer methods 0 and 1 would fill
+    computeCubeSubbuffer((cubeDrawingIndex - numberOfCubesPreComputed + numberOfCubeSubbuffers) % numberOfCubeSubbuffers);
+
+    // draw some cubes
+    drawCubeSubbuffer(cubeDrawingIndex);
+
+    // end timing
+    glFlush();
+    glEndQuery(GL_TIME_ELAPSED);
+    glFlush();
+
+    CHECK_GL_ERROR();
+}
+
+// draws resident chunks from their slots of the pool, the streaming thread writes slots no draw reads
+void drawCubesChunks() {
+    updateCubeUniforms();
+
+    // set a uniform that tells if we use texture
+    glUniform1i(handler.useEmissionTexture, 0);
+    setVertexSourceUniforms(packedVertices, false);
+
+    // begin timing
+    glFlush();
+    glBeginQuery(GL_TIME_ELAPSED, vertexQueries[thisFrameIndex++]);
+    glFlush();
+
+    // take the newest resident set, its chunks are drawn until a newer one is published
+    {
+        std::lock_guard<std::mutex> lock(chunkDrawListMutex);
+        if (chunkListPublished) {
+            drawnChunks = std::move(publishedChunks);
+            publishedChunks.uploaded = nullptr;
+            chunkListPublished = false;
+        }
+    }
+    if (drawnChunks.uploaded != nullptr) {
+        glWaitSync(drawnChunks.uploaded, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(drawnChunks.uploaded);
+        drawnChunks.uploaded = nullptr;
+    }
+
+    // commands are written to the part of the indirect buffer read numberOfCubeSubbuffers frames ago
+    chunkCommandsIndex = (chunkCommandsIndex + 1) % numberOfCubeSubbuffers;
+    if (chunkCommandsFence[chunkCommandsIndex] != nullptr) {
+        glClientWaitSync(chunkCommandsFence[chunkCommandsIndex], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(chunkCommandsFence[chunkCommandsIndex]);
+    }
+
+    // one command for every resident chunk in the view frustum, starting at the first vertex of its slot
+    if (culler != nullptr)
+        cullCubes();
+    drawArraysIndirectCommand* commands = chunkCommandsPointer + residency->slotCount() * chunkCommandsIndex;
+    GLsizei nCommands = 0;
+    for (size_t i = 0; i < drawnChunks.chunks.size(); i++)
+    {
+        if (culler != nullptr && !culler->brickVisibleInLastCull(drawnChunks.chunks[i]))
+            continue;
+        commands[nCommands++] = { GLuint(drawnChunks.counts[i]), 1, GLuint(drawnChunks.firsts[i]), 0 };
+    }
+    chunkCommandsDrawn = nCommands;
+
+    // every visible chunk is drawn by one call
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, handler.models[3].indirectBufferObject);
+    if (nCommands > 0)
+        glMultiDrawArraysIndirect(GL_TRIANGLES, (const void*)(sizeof(drawArraysIndirectCommand) * residency->slotCount() * chunkCommandsIndex), nCommands, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    chunkCommandsFence[chunkCommandsIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    // tell the streaming thread which version is drawn, the fence is flushed so the other context can wait for it
+    GLsync drawn = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    {
+        std::lock_guard<std::mutex> lock(chunkDrawListMutex);
+        // a newer draw is signaled after the older one, so the older fence is not needed
+        if (chunkDrawnFence != nullptr)
+            glDeleteSync(chunkDrawnFence);
+        chunkDrawnFence = drawn;
+        chunkDrawnVersion = drawnChunks.version;
+    }
+    chunkDrawnCondition.notify_one();
+
+    // end timing
+    glFlush();
+    glEndQuery(GL_TIME_ELAPSED);
+    glFlush();
+
+    CHECK_GL_ERROR();
+}
+
 void drawModels() {
     if (drawTextures)
         if (useAsynchTextures)
@@ -454,10 +934,39 @@ void drawModels() {
             drawCubes();
         else if (bufferMethod == 2)
             drawCubesMethod2();
+        else if (bufferMethod == 5)
+            drawCubesProcedural();
+        else if (bufferMethod == 6)
+            drawCubesCompute();
+        else if (bufferMethod == 7)
+            drawCubesChunks();
         else
+            // method 4 streams cube offsets with the same thread as method 3
             drawCubesMethod3();
 }
 
+// sets attributes of cube vertices stored in the bound array buffer, packed or 8 floats
+void setCubeVertexAttributes() {
+    if (packedVertices) {
+        // 16-bit positions with chunk index read as integers, normals decoded to [-1, 1], no tex coords
+        glVertexAttribIPointer(4, 4, GL_SHORT, sizeof(packedCubeVertex), (void*)0);
+        glEnableVertexAttribArray(4);
+
+        glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(packedCubeVertex), (void*)(4 * sizeof(GLshort)));
+        glEnableVertexAttribArray(2);
+    }
+    else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+    }
+}
+
 void addModels() {
 
     // add square
@@ -501,119 +1010,838 @@ void addModels() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glGenTextures(1, &handler.models[0].meshMaterial.emissionTexture[1]);
-    glBindTexture(GL_TEXTURE_2D, handler.models[0].meshMaterial.emissionTexture[1]); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glGenTextures(1, &handler.models[0].meshMaterial.emissionTexture[1]);
+    glBindTexture(GL_TEXTURE_2D, handler.models[0].meshMaterial.emissionTexture[1]); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
+    // set the texture wrapping parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    // set texture filtering parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // add cubes
+    handler.models[1].numTriangles = cubesSize;
+    handler.models[1].meshMaterial.useEmissionTexture = 1;
+    handler.models[1].meshMaterial.ambient = glm::vec3(0.1f);
+    handler.models[1].meshMaterial.diffuse = glm::vec3(1.0f);
+    handler.models[1].meshMaterial.specular = glm::vec3(1.0f);
+    handler.models[1].meshMaterial.emission = glm::vec3(0.1f);
+    handler.models[1].meshMaterial.shininess = 3.0f;
+
+    glUseProgram(handler.program);
+    glGenVertexArrays(1, &handler.models[1].vertexArrayObject);
+
+    glBindVertexArray(handler.models[1].vertexArrayObject);
+
+    // with chunk streaming only the pool of chunk slots is allocated, the whole grid is never stored
+    if (residency == nullptr) {
+        // persistent storage lets us copy data to the buffer while another thread is drawing from it
+        cubeRing = new persistentRing(cubeSubbufferSize(), numberOfCubeSubbuffers);
+        handler.models[1].vertexBufferObject = cubeRing->bufferObject();
+
+        GLubyte* pointer = (GLubyte*)glMapBufferRange(GL_ARRAY_BUFFER, 0, cubeSubbufferSize() * numberOfCubesPreComputed, GL_MAP_WRITE_BIT);
+        // the driver may refuse the storage even below maxCubeRingBytes
+        if (pointer == nullptr) {
+            std::cerr << "cannot allocate " << cubeSubbufferSize() * numberOfCubeSubbuffers / (1024 * 1024) << " MB of the cube buffer" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < numberOfCubesPreComputed; i++)
+        {
+            fillCubeArray(pointer);
+            pointer += cubeSubbufferSize();
+        }
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    else {
+        glGenBuffers(1, &handler.models[1].vertexBufferObject);
+        glBindBuffer(GL_ARRAY_BUFFER, handler.models[1].vertexBufferObject);
+    }
+    // parts of the buffer are drawn whole until they are filled by a vertex method
+    for (size_t i = 0; i < numberOfCubeSubbuffers; i++)
+    {
+        subbufferCubes[i] = nCubes;
+        subbufferVertices[i] = cubesSize;
+        subbufferImpostors[i] = 0;
+    }
+
+    setCubeVertexAttributes();
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    CHECK_GL_ERROR();
+
+    // pool of chunk slots written by the streaming thread while the main thread draws other slots (method 7)
+    if (residency != nullptr) {
+        handler.models[3].numTriangles = residency->slotCount() * chunkSlotSize() / cubeVertexSize() / 3;
+        handler.models[3].meshMaterial = handler.models[1].meshMaterial;
+
+        glGenVertexArrays(1, &handler.models[3].vertexArrayObject);
+        glGenBuffers(1, &handler.models[3].vertexBufferObject);
+        glBindVertexArray(handler.models[3].vertexArrayObject);
+        glBindBuffer(GL_ARRAY_BUFFER, handler.models[3].vertexBufferObject);
+
+        // coherent mapping makes written slots visible to draws issued after the fence of the streaming thread without unmapping
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, chunkSlotSize() * residency->slotCount(), NULL, flags);
+        chunkPoolPointer = glMapBufferRange(GL_ARRAY_BUFFER, 0, chunkSlotSize() * residency->slotCount(), flags);
+
+        setCubeVertexAttributes();
+
+        // draw commands of visible chunks, at most one for every slot in each part
+        glGenBuffers(1, &handler.models[3].indirectBufferObject);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, handler.models[3].indirectBufferObject);
+        const size_t commandsSize = sizeof(drawArraysIndirectCommand) * residency->slotCount() * numberOfCubeSubbuffers;
+        glBufferStorage(GL_DRAW_INDIRECT_BUFFER, commandsSize, NULL, flags);
+        chunkCommandsPointer = (drawArraysIndirectCommand*)glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, 0, commandsSize, flags);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        CHECK_GL_ERROR();
+    }
+
+    // vertex array object for cubes generated in the vertex shader
+    glGenVertexArrays(1, &handler.emptyVertexArrayObject);
+
+    // add instanced cubes, one cube mesh and a streamed offset for every cube
+    handler.models[2].numTriangles = nCubeTriangles / 3;
+    handler.models[2].meshMaterial = handler.models[1].meshMaterial;
+
+    glGenVertexArrays(1, &handler.models[2].vertexArrayObject);
+    glGenBuffers(1, &handler.models[2].vertexBufferObject);
+    glGenBuffers(1, &handler.models[2].instanceBufferObject);
+
+    glBindVertexArray(handler.models[2].vertexArrayObject);
+
+    // the mesh never changes, so it is uploaded only once
+    glBindBuffer(GL_ARRAY_BUFFER, handler.models[2].vertexBufferObject);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeVertexTemplate.data), cubeVertexTemplate.data, GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+
+    // offsets are split to the same number of parts as cube vertices in methods 0-3
+    glBindBuffer(GL_ARRAY_BUFFER, handler.models[2].instanceBufferObject);
+    glBufferStorage(GL_ARRAY_BUFFER, instanceSubbufferSize() * numberOfCubeSubbuffers, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
+
+    GLfloat* offsets = (GLfloat*)glMapBufferRange(GL_ARRAY_BUFFER, 0, instanceSubbufferSize() * numberOfCubesPreComputed, GL_MAP_WRITE_BIT);
+    for (size_t i = 0; i < numberOfCubesPreComputed; i++)
+    {
+        fillCubeInstances(offsets, i);
+        offsets += 3 * nCubes;
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(3);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    CHECK_GL_ERROR();
+}
+
+// vertex array object drawn by the current vertex method
+GLuint cubeVertexArray(unsigned char method) {
+    if (method == 4)
+        return handler.models[2].vertexArrayObject;
+    if (method == 5)
+        return handler.emptyVertexArrayObject;
+    if (method == 7)
+        return handler.models[3].vertexArrayObject;
+    return handler.models[1].vertexArrayObject;
+}
+
+// writes an offset of every cube to the part of the instance buffer with index "index", only visible cubes with frustum culling
+void fillCubeInstances(GLfloat* offsets, unsigned int index) {
+    if (culler == nullptr) {
+        visibleCubeRuns.assign(1, std::make_pair(size_t(0), size_t(nCubes)));
+        subbufferCubes[index] = nCubes;
+    }
+    else {
+        subbufferCubes[index] = cullCubes();
+    }
+
+    for (const std::pair<size_t, size_t>& run : visibleCubeRuns)
+    {
+        for (size_t i = run.first; i < run.second; i++)
+        {
+            *offsets++ = cubeSpacing * (i % nCubesCol);
+            *offsets++ = cubeSpacing * (i / nCubesCol % nCubesRow);
+            *offsets++ = cubeSpacing * (i / (nCubesCol * nCubesRow));
+        }
+    }
+}
+
+void fillCubeArrayScalar(void* newCubesData, size_t first, size_t last) {
+    GLfloat* newCubes = (GLfloat*)newCubesData;
+    for (size_t i = first; i < last; i++)
+    {
+        const size_t x = i % nCubesCol;
+        const size_t y = i / nCubesCol % nCubesRow;
+        const size_t z = i / (nCubesCol * nCubesRow);
+
+        GLfloat* cube = newCubes + (i - first) * nCubeTriangles * 8;
+        for (size_t v = 0; v < nCubeTriangles; v++)
+        {
+            const GLfloat* vertex = cubeVertexTemplate.data + v * 8;
+            cube[v * 8] = vertex[0] + cubeSpacing * x;        // pos x
+            cube[v * 8 + 1] = vertex[1] + cubeSpacing * y;    // pos y
+            cube[v * 8 + 2] = vertex[2] + cubeSpacing * z;    // pos z
+            cube[v * 8 + 3] = vertex[3];                      // tex u
+            cube[v * 8 + 4] = vertex[4];                      // tex v
+
+            cube[v * 8 + 5] = vertex[5];                      // norm x
+            cube[v * 8 + 6] = vertex[6];                      // norm y
+            cube[v * 8 + 7] = vertex[7];                      // norm z
+        }
+    }
+}
+
+void addSlabTime(unsigned int slab, double time) {
+    std::lock_guard<std::mutex> lock(slabTimesMutex);
+    slabTimes[slab] += time;
+    slabSamples[slab]++;
+}
+
+void fillCubeArray(void* newCubes) {
+    if (fillPool == nullptr) {
+        cubeArrayFiller(newCubes, 0, nCubes);
+        return;
+    }
+
+    // every worker writes its own z-slab, so the written ranges of the buffer never overlap
+    const unsigned int nSlabs = fillPool->size();
+    fillPool->dispatch(nSlabs, [newCubes, nSlabs](unsigned int slab) {
+        const size_t zBegin = nCubesDepth * slab / nSlabs;
+        const size_t zEnd = nCubesDepth * (slab + 1) / nSlabs;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        const size_t first = zBegin * nCubesCol * nCubesRow;
+        cubeArrayFiller((GLubyte*)newCubes + first * cubeVertexSize() * nCubeTriangles, first, zEnd * nCubesCol * nCubesRow);
+        std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+        addSlabTime(slab, time.count());
+    });
+    fillPool->wait();
+}
+
+// calls fill(firstCube, lastCube, position) for parts of the ranges with cubes from begin to end of the sequence of all their cubes,
+// position is the index of firstCube in this sequence
+template <typename Fill>
+void forCubeRunsPart(const std::vector<std::pair<size_t, size_t>>& runs, size_t begin, size_t end, Fill fill) {
+    size_t position = 0;
+    for (const std::pair<size_t, size_t>& run : runs)
+    {
+        const size_t first = std::max(position, begin);
+        const size_t last = std::min(position + run.second - run.first, end);
+        if (first < last)
+            fill(run.first + first - position, run.first + last - position, first);
+
+        position += run.second - run.first;
+        if (position >= end)
+            break;
+    }
+}
+
+// writes cubes of the ranges by filler one after another from the beginning of newCubes, cubes from begin to end of this sequence are written
+void fillCubeRunsPart(void* newCubes, const std::vector<std::pair<size_t, size_t>>& runs, size_t begin, size_t end, void (*filler)(void*, size_t, size_t), size_t cubeBytes) {
+    forCubeRunsPart(runs, begin, end, [newCubes, filler, cubeBytes](size_t first, size_t last, size_t position) {
+        filler((GLubyte*)newCubes + position * cubeBytes, first, last);
+    });
+}
+
+// compact version of fillCubeArray, writes only cubes of the ranges, total is the number of these cubes and every cube takes cubeBytes
+void fillCubeRuns(void* newCubes, const std::vector<std::pair<size_t, size_t>>& runs, size_t total, void (*filler)(void*, size_t, size_t), size_t cubeBytes) {
+    if (fillPool == nullptr) {
+        fillCubeRunsPart(newCubes, runs, 0, total, filler, cubeBytes);
+        return;
+    }
+
+    // every worker writes the same number of cubes, slabs are parts of the compacted sequence
+    const unsigned int nSlabs = fillPool->size();
+    fillPool->dispatch(nSlabs, [newCubes, &runs, total, nSlabs, filler, cubeBytes](unsigned int slab) {
+        auto start = std::chrono::high_resolution_clock::now();
+        fillCubeRunsPart(newCubes, runs, total * slab / nSlabs, total * (slab + 1) / nSlabs, filler, cubeBytes);
+        std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+        addSlabTime(slab, time.count());
+    });
+    fillPool->wait();
+}
+
+glm::vec3 cameraPosition() {
+    return publishedCamera.read().position;
+}
+
+// number of vertices of faces turned to the camera of cubes from first to last
+size_t countCubeFaces(size_t first, size_t last, const GLfloat* camera) {
+    size_t faces = 0;
+    for (size_t i = first; i < last; i++)
+    {
+        const unsigned int visible = visibleCubeFaces(cubeSpacing * (i % nCubesCol), cubeSpacing * (i / nCubesCol % nCubesRow), cubeSpacing * (i / (nCubesCol * nCubesRow)), camera, faceMargin);
+        for (unsigned int f = 0; f < cubeFaceCount; f++)
+            faces += (visible >> f) & 1;
+    }
+    return faces * faceVertexCount;
+}
+
+// writes only faces turned to the camera of cubes of the ranges, total is the number of these cubes, returns the number of written vertices
+size_t fillCubeFaces(void* newCubes, const std::vector<std::pair<size_t, size_t>>& runs, size_t total) {
+    const glm::vec3 position = cameraPosition();
+    const GLfloat camera[3] = { position.x, position.y, position.z };
+    const size_t vertexSize = cubeVertexSize();
+
+    if (fillPool == nullptr) {
+        size_t written = 0;
+        forCubeRunsPart(runs, 0, total, [&](size_t first, size_t last, size_t) {
+            written += cubeFaceFiller((GLubyte*)newCubes + written * vertexSize, first, last, camera, faceMargin);
+        });
+        return written;
+    }
+
+    // vertices of every slab are counted first, so every worker knows where its slab begins
+    const unsigned int nSlabs = fillPool->size();
+    std::vector<size_t> slabBegin(nSlabs + 1, 0);
+    fillPool->dispatch(nSlabs, [&](unsigned int slab) {
+        size_t vertices = 0;
+        forCubeRunsPart(runs, total * slab / nSlabs, total * (slab + 1) / nSlabs, [&](size_t first, size_t last, size_t) {
+            vertices += countCubeFaces(first, last, camera);
+        });
+        slabBegin[slab + 1] = vertices;
+    });
+    fillPool->wait();
+    std::partial_sum(slabBegin.begin(), slabBegin.end(), slabBegin.begin());
+
+    fillPool->dispatch(nSlabs, [&](unsigned int slab) {
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t written = slabBegin[slab];
+        forCubeRunsPart(runs, total * slab / nSlabs, total * (slab + 1) / nSlabs, [&](size_t first, size_t last, size_t) {
+            written += cubeFaceFiller((GLubyte*)newCubes + written * vertexSize, first, last, camera, faceMargin);
+        });
+        std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+        addSlabTime(slab, time.count());
+    });
+    fillPool->wait();
+    return slabBegin[nSlabs];
+}
+
+// adds cubes from first to last to the ranges, joins them with the last range if they follow it, returns the number of added cubes
+size_t appendCubeRun(std::vector<std::pair<size_t, size_t>>& runs, size_t first, size_t last) {
+    if (first >= last)
+        return 0;
+    if (!runs.empty() && runs.back().second == first)
+        runs.back().second = last;
+    else
+        runs.emplace_back(first, last);
+    return last - first;
+}
+
+// cubes of a row with index x from the returned first to last (excluded) have their centers closer than distance to the camera
+std::pair<size_t, size_t> cubesInDistance(const glm::vec3& camera, size_t y, size_t z, float distance) {
+    const float dy = cubeSpacing * y - camera.y, dz = cubeSpacing * z - camera.z;
+    const float squared = distance * distance - dy * dy - dz * dz;
+    if (squared < 0.0f)
+        return std::make_pair(size_t(0), size_t(0));
+
+    const float half = std::sqrt(squared);
+    const float first = std::ceil((camera.x - half) / cubeSpacing), last = std::floor((camera.x + half) / cubeSpacing) + 1;
+    return std::make_pair(size_t(std::max(first, 0.0f)), size_t(std::min(std::max(last, 0.0f), float(nCubesCol))));
+}
+
+// splits cubes of visibleCubeRuns by the distance from the camera: nearer than impostorDistance stay in visibleCubeRuns,
+// nearer than lodDropDistance go to impostorCubeRuns and the rest is not drawn, returns the numbers of near cubes and impostors
+std::pair<size_t, size_t> splitCubeRunsByDistance() {
+    const glm::vec3 camera = cameraPosition();
+    std::vector<std::pair<size_t, size_t>> near;
+    impostorCubeRuns.clear();
+    size_t nearCubes = 0, impostors = 0;
+
+    for (const std::pair<size_t, size_t>& run : visibleCubeRuns)
+    {
+        // a range may continue over several rows, distances change only along x inside a row
+        for (size_t rowFirst = run.first; rowFirst < run.second;)
+        {
+            const size_t row = rowFirst / nCubesCol;
+            const size_t rowLast = std::min(run.second, (row + 1) * nCubesCol);
+            const size_t y = row % nCubesRow, z = row / nCubesRow;
+            const size_t x0 = rowFirst - row * nCubesCol, x1 = rowLast - row * nCubesCol;
+
+            // cubes in impostorDistance are inside cubes in lodDropDistance, impostors are on both sides of them
+            std::pair<size_t, size_t> drawn = cubesInDistance(camera, y, z, lodDropDistance);
+            drawn = std::make_pair(std::max(drawn.first, x0), std::min(drawn.second, x1));
+            std::pair<size_t, size_t> full = cubesInDistance(camera, y, z, impostorDistance);
+            full = std::make_pair(std::max(full.first, drawn.first), std::min(full.second, drawn.second));
+            if (full.first >= full.second)
+                full = std::make_pair(drawn.second, drawn.second);
+
+            impostors += appendCubeRun(impostorCubeRuns, row * nCubesCol + drawn.first, row * nCubesCol + full.first);
+            nearCubes += appendCubeRun(near, row * nCubesCol + full.first, row * nCubesCol + full.second);
+            impostors += appendCubeRun(impostorCubeRuns, row * nCubesCol + full.second, row * nCubesCol + drawn.second);
+            rowFirst = rowLast;
+        }
+    }
+    visibleCubeRuns.swap(near);
+    return std::make_pair(nearCubes, impostors);
+}
+
+// finds cubes visible from the current camera, returns the number of them
+size_t cullCubes() {
+    return culler->cull(cameraProjection() * cameraView(), cullingMargin, visibleCubeRuns);
+}
+
+// marks cubes from first to last as changed in every part of the buffer
+void markCubesDirty(size_t first, size_t last) {
+    std::lock_guard<std::mutex> lock(dirtyCubesMutex);
+    for (size_t i = 0; i < numberOfCubeSubbuffers; i++)
+    {
+        if (dirtyCubes[i].size() < maxDirtyRanges) {
+            dirtyCubes[i].emplace_back(first, last);
+        }
+        else {
+            dirtyCubes[i].clear();
+            dirtyCubes[i].emplace_back(0, nCubes);
+        }
+    }
+}
+
+// simulates a scene in which a small part of cubes changes every update
+void changeRandomCubes() {
+    const size_t changed = size_t(nCubes * changedCubesFraction);
+    for (size_t i = 0; i < changed; i++)
+    {
+        const size_t cube = ((size_t)rand() * (RAND_MAX + (size_t)1) + rand()) % nCubes;
+        markCubesDirty(cube, cube + 1);
+    }
+}
+
+// takes changed ranges of one part of the buffer, sorted and with overlapping or adjacent ranges merged
+std::vector<std::pair<size_t, size_t>> takeDirtyCubes(unsigned int index) {
+    std::vector<std::pair<size_t, size_t>> ranges;
+    {
+        std::lock_guard<std::mutex> lock(dirtyCubesMutex);
+        ranges.swap(dirtyCubes[index]);
+    }
+    if (ranges.empty())
+        return ranges;
+
+    std::sort(ranges.begin(), ranges.end());
+    size_t merged = 0;
+    for (size_t i = 1; i < ranges.size(); i++)
+    {
+        if (ranges[i].first <= ranges[merged].second)
+            ranges[merged].second = std::max(ranges[merged].second, ranges[i].second);
+        else
+            ranges[++merged] = ranges[i];
+    }
+    ranges.resize(merged + 1);
+    return ranges;
+}
+
+// flags for mapping a part of the cube buffer, incremental updates flush only the changed ranges
+GLbitfield cubeMapFlags(GLbitfield flags) {
+    if (incrementalUpdates)
+        flags |= GL_MAP_FLUSH_EXPLICIT_BIT;
+    return flags;
+}
+
+// cubes written to the buffer depend on the camera, so parts of the buffer are always written whole
+bool cameraDependentCubes() {
+    return culler != nullptr || visibleFacesOnly || impostorDistance > 0.0f;
+}
+
+// fills a mapped part of the cube buffer with index "index", the whole part or only changed cubes with incremental updates
+// flush is true if the part was mapped with cubeMapFlags, so the written ranges have to be flushed explicitly
+void fillCubeSubbuffer(void* mapped, unsigned int index, bool flush) {
+    subbufferImpostors[index] = 0;
+    subbufferDroppedCubes[index] = 0;
+    if (cameraDependentCubes()) {
+        if (culler != nullptr) {
+            subbufferCubes[index] = cullCubes();
+        }
+        else {
+            visibleCubeRuns.assign(1, std::make_pair(size_t(0), size_t(nCubes)));
+            subbufferCubes[index] = nCubes;
+        }
+
+        if (impostorDistance > 0.0f) {
+            const std::pair<size_t, size_t> lods = splitCubeRunsByDistance();
+            subbufferDroppedCubes[index] = subbufferCubes[index] - lods.first - lods.second;
+            subbufferCubes[index] = lods.first;
+            subbufferImpostors[index] = lods.second;
+
+            // near cubes never reach the point sprites, each of them has more vertices than one sprite
+            const size_t vertexSize = cubeVertexSize();
+            fillCubeRuns((GLubyte*)mapped + (cubesSize - lods.second) * vertexSize, impostorCubeRuns, lods.second, cubePointFiller, vertexSize);
+        }
+
+        if (visibleFacesOnly) {
+            subbufferVertices[index] = fillCubeFaces(mapped, visibleCubeRuns, subbufferCubes[index]);
+        }
+        else {
+            fillCubeRuns(mapped, visibleCubeRuns, subbufferCubes[index], cubeArrayFiller, cubeVertexSize() * nCubeTriangles);
+            subbufferVertices[index] = subbufferCubes[index] * nCubeTriangles;
+        }
+        return;
+    }
+
+    subbufferCubes[index] = nCubes;
+    subbufferVertices[index] = cubesSize;
+    if (!incrementalUpdates) {
+        fillCubeArray(mapped);
+        return;
+    }
+
+    const size_t cubeBytes = cubeVertexSize() * nCubeTriangles;
+    for (const std::pair<size_t, size_t>& range : takeDirtyCubes(index))
+    {
+        // the whole grid is generated by all fill threads
+        if (range.first == 0 && range.second == nCubes)
+            fillCubeArray(mapped);
+        else
+            cubeArrayFiller((GLubyte*)mapped + range.first * cubeBytes, range.first, range.second);
+
+        // offset is relative to the beginning of the mapped range
+        if (flush)
+            glFlushMappedBufferRange(GL_ARRAY_BUFFER, range.first * cubeBytes, (range.second - range.first) * cubeBytes);
+    }
+}
+
+void startFillPool() {
+    if (fillThreads == 1)
+        return;
+
+    fillPool = new workerPool(fillThreads);
+    slabTimes.assign(fillPool->size(), 0.0);
+    slabSamples.assign(fillPool->size(), 0);
+    std::cout << "generating cubes on " << fillPool->size() << " threads" << std::endl;
+}
+
+// prints average time of every z-slab since the last report
+void reportSlabTimes() {
+    if (fillPool == nullptr)
+        return;
+
+    std::lock_guard<std::mutex> lock(slabTimesMutex);
+    for (size_t i = 0; i < slabTimes.size(); i++)
+    {
+        if (slabSamples[i] > 0)
+            std::cout << "  slab " << i << ": " << slabTimes[i] / slabSamples[i] << " s" << std::endl;
+        slabTimes[i] = 0;
+        slabSamples[i] = 0;
+    }
+}
+
+// prints the number of cubes and triangles drawn in the last frame and cubes of every level of detail when they depend on the camera
+void reportVisibleCubes() {
+    if (bufferMethod == 7) {
+        std::cout << "  resident chunks: " << drawnChunks.counts.size() << " of " << residency->slotCount() << " slots, drawn chunks: " << chunkCommandsDrawn << std::endl;
+        return;
+    }
+    if (!cameraDependentCubes() || bufferMethod > 4)
+        return;
+
+    std::cout << "  visible cubes: " << subbufferCubes[cubeDrawingIndex] << " of " << nCubes;
+    if (bufferMethod != 4)
+        std::cout << ", triangles: " << subbufferVertices[cubeDrawingIndex] / 3 << " of " << cubesSize / 3;
+    std::cout << std::endl;
+    if (impostorDistance > 0.0f && bufferMethod != 4)
+        std::cout << "  lod: " << subbufferCubes[cubeDrawingIndex] << " full, " << subbufferImpostors[cubeDrawingIndex] << " point sprites, "
+            << subbufferDroppedCubes[cubeDrawingIndex] << " too far" << std::endl;
+}
+
+// picks the fastest generator the CPU supports, fillCubeArrayScalar stays as the reference
+bool selectCubeArrayFiller() {
+    const cubeGridEntry* grid = nullptr;
+    for (unsigned int i = 0; i < nCubeGrids; i++)
+    {
+        if (cubeGrids[i].nx == cubeGridSize)
+            grid = &cubeGrids[i];
+    }
+    if (grid == nullptr) {
+        std::cerr << "grid of size " << cubeGridSize << " is not registered in cubeGrid.h" << std::endl;
+        return false;
+    }
+
+    nCubesCol = grid->nx;
+    nCubesRow = grid->ny;
+    nCubesDepth = grid->nz;
+    nCubes = nCubesRow * nCubesCol * nCubesDepth;
+    cubesSize = nCubeTriangles * nCubes;
+
+    // chunk streaming keeps only a pool of chunks, other methods keep every cube in each part of the ring
+    const size_t maxDepth = maxCubeRingBytes / cubeSubbufferSize();
+    if (chunkStreamingRadius <= 0.0f && maxDepth >= 2 && numberOfCubeSubbuffers > maxDepth) {
+        std::cerr << "ring depth " << numberOfCubeSubbuffers << " is too deep for grid " << nCubesCol << "x" << nCubesRow << "x" << nCubesDepth
+            << ", at most " << maxDepth << " parts fit to " << maxCubeRingBytes / (1024 * 1024) << " MB" << std::endl;
+        return false;
+    }
+    if (chunkStreamingRadius <= 0.0f && cubeSubbufferSize() * numberOfCubeSubbuffers > maxCubeRingBytes) {
+        std::cerr << "grid " << nCubesCol << "x" << nCubesRow << "x" << nCubesDepth << " needs " << cubeSubbufferSize() * numberOfCubeSubbuffers / (1024 * 1024)
+            << " MB for " << numberOfCubeSubbuffers << " parts of the cube buffer, at most " << maxCubeRingBytes / (1024 * 1024) << " MB are allocated, use a smaller -grid or -chunk-streaming" << std::endl;
+        return false;
+    }
+
+    if (packedVertices) {
+        cubeArrayFiller = grid->fillPacked;
+        cubeFaceFiller = grid->fillFacesPacked;
+        cubePointFiller = grid->fillPointsPacked;
+        std::cout << "cube generator: packed vertices, grid " << nCubesCol << "x" << nCubesRow << "x" << nCubesDepth << std::endl;
+        return true;
+    }
+
+    cubePointFiller = grid->fillPoints;
+    if (useReferenceFiller) {
+        cubeArrayFiller = fillCubeArrayScalar;
+        cubeFaceFiller = grid->fillFaces[simd::scalar];
+        std::cout << "cube generator: reference, grid " << nCubesCol << "x" << nCubesRow << "x" << nCubesDepth << std::endl;
+        return true;
+    }
+
+    simd::level level = simd::detect();
+    if (level > maxSimdLevel)
+        level = maxSimdLevel;
+    cubeArrayFiller = streamingStores ? grid->fillStream[level] : grid->fill[level];
+    // faces of a cube are not whole cache lines, so they are written by plain stores
+    cubeFaceFiller = grid->fillFaces[level];
+    std::cout << "cube generator: " << simd::name(level) << (streamingStores && level != simd::scalar ? " streaming" : "") << ", grid " << nCubesCol << "x" << nCubesRow << "x" << nCubesDepth << std::endl;
+    return true;
+}
+
+// measures the cube generator with streaming and plain stores, writing to a mapped part of the cube buffer and to CPU memory
+void runStoreBenchmark() {
+    const cubeGridEntry* grid = nullptr;
+    for (unsigned int i = 0; i < nCubeGrids; i++)
+    {
+        if (cubeGrids[i].nx == cubeGridSize)
+            grid = &cubeGrids[i];
+    }
+    simd::level level = std::min(simd::detect(), maxSimdLevel);
+    const size_t bytes = 8 * sizeof(GLfloat) * cubesSize;
+    const unsigned int repeats = 5;
+
+    // buffer in CPU memory aligned to a cache line
+    std::vector<GLfloat> heapBuffer(bytes / sizeof(GLfloat) + 16);
+    void* heapPointer = (void*)(((size_t)heapBuffer.data() + 63) & ~(size_t)63);
+
+    glBindBuffer(GL_ARRAY_BUFFER, handler.models[1].vertexBufferObject);
+    for (int target = 0; target < 2; target++)
+    {
+        for (int stream = 0; stream < 2; stream++)
+        {
+            void (*filler)(void*, size_t, size_t) = stream ? grid->fillStream[level] : grid->fill[level];
+            double best = 1e30;
+            for (unsigned int r = 0; r < repeats; r++)
+            {
+                void* pointer = heapPointer;
+                if (target == 0)
+                    pointer = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+
+                auto start = std::chrono::high_resolution_clock::now();
+                filler(pointer, 0, nCubes);
+                std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - start;
+                best = std::min(best, time.count());
+
+                if (target == 0)
+                    glUnmapBuffer(GL_ARRAY_BUFFER);
+            }
+            std::cout << (target == 0 ? "mapped buffer, " : "cpu memory, ") << (stream ? "streaming stores: " : "plain stores: ")
+                << best << " s, " << bytes / best / 1e9 << " GB/s" << std::endl;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    CHECK_GL_ERROR();
+}
+
+// files of the textures, texture i is decoded to handler.textures[i]
+const char* textureFiles[handler.nTextures] = { "tex1.jpg", "tex2.jpg", "tex3.jpg", "tex4.jpg", "tex5.jpg", "tex6.jpg" };
+// time of decoding of every texture in seconds
+double textureDecodeTimes[handler.nTextures];
 
-    // add cubes
-    handler.models[1].numTriangles = cubesSize;
-    handler.models[1].meshMaterial.useEmissionTexture = 1;
-    handler.models[1].meshMaterial.ambient = glm::vec3(0.1f);
-    handler.models[1].meshMaterial.diffuse = glm::vec3(1.0f);
-    handler.models[1].meshMaterial.specular = glm::vec3(1.0f);
-    handler.models[1].meshMaterial.emission = glm::vec3(0.1f);
-    handler.models[1].meshMaterial.shininess = 3.0f;
+// slot of the texture decoded by this thread until the decoder allocates its image there, and bytes of that image
+thread_local GLubyte* textureSinkSlot = nullptr;
+thread_local size_t textureSinkBytes = 0;
 
-    glUseProgram(handler.program);
-    glGenVertexArrays(1, &handler.models[1].vertexArrayObject);
-    glGenBuffers(1, &handler.models[1].vertexBufferObject);
-    glGenBuffers(1, &handler.models[1].elementBufferObject);
+bool inTextureStore(void* memory) {
+    return textureStorePointer != nullptr && (GLubyte*)memory >= textureStorePointer && (GLubyte*)memory < textureStorePointer + textureSlotSize * textureRingSlots;
+}
 
-    glBindVertexArray(handler.models[1].vertexArrayObject);
+// the decoder allocates the decoded image once, its buffers of components and lines are smaller and go to the heap
+void* textureSinkMalloc(size_t size) {
+    if (textureSinkSlot != nullptr && size >= textureSinkBytes && size <= textureSlotSize) {
+        void* slot = textureSinkSlot;
+        textureSinkSlot = nullptr;
+        return slot;
+    }
+    return malloc(size);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, handler.models[1].vertexBufferObject);
+void* textureSinkRealloc(void* memory, size_t size) {
+    // a slot cannot grow, the decoder then fails as if it ran out of memory
+    if (inTextureStore(memory))
+        return size <= textureSlotSize ? memory : nullptr;
+    return realloc(memory, size);
+}
 
-    // GL_MAP_PERSISTENT_BIT lets us copy data to the buffer while another thread is drawing from it
-    glBufferStorage(GL_ARRAY_BUFFER, sizeof(GLfloat) * cubesSize * 8 * numberOfCubeSubbuffers, NULL, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
+void textureSinkFree(void* memory) {
+    if (!inTextureStore(memory))
+        free(memory);
+}
 
-    GLfloat* pointer = (GLfloat*)glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * cubesSize * 8 * numberOfCubesPreComputed, GL_MAP_WRITE_BIT);
+size_t textureBytes(unsigned int i) {
+    return size_t(handler.widths[i]) * handler.heights[i] * 3;
+}
 
-    for (size_t i = 0; i < numberOfCubesPreComputed; i++)
+// creates the texture ring with slots of the size of the largest texture, textures may differ in size
+bool createTextureStore() {
+    size_t largest = 0;
+    for (size_t i = 0; i < handler.nTextures; i++)
     {
-        fillCubeArray(pointer);
-        pointer += cubesSize * 8;
+        int channels;
+        if (!stbi_info(textureFiles[i], &(handler.widths[i]), &(handler.heights[i]), &channels)) {
+            std::cerr << "cannot read " << textureFiles[i] << ": " << stbi_failure_reason() << std::endl;
+            return false;
+        }
+        largest = std::max(largest, textureBytes(i));
+    }
+    textureSlotSize = (largest + 1 + 255) / 256 * 256;
+    for (size_t slot = 0; slot < textureRingSlots; slot++)
+    {
+        textureInSlot[slot] = -1;
+        textureSlotUploaded[slot] = false;
+        textureSlotFence[slot] = nullptr;
     }
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    // the CPU only writes the store, every upload reads it as a bound pixel unpack buffer
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &textureStore);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, textureStore);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, textureSlotSize * textureRingSlots, NULL, flags);
+    textureStorePointer = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, textureSlotSize * textureRingSlots, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    CHECK_GL_ERROR();
+    return textureStorePointer != nullptr;
+}
 
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+// decodes texture i into the slot, the slot must not be read by an upload
+bool decodeTextureToSlot(unsigned int i, unsigned int slot) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    GLubyte* slotPointer = textureStorePointer + textureSlotSize * slot;
+    int width, height, channels;
+    textureSinkSlot = slotPointer;
+    textureSinkBytes = textureBytes(i);
+    stbi_uc* image = stbi_load(textureFiles[i], &width, &height, &channels, 3);
+    textureSinkSlot = nullptr;
+    // an image the decoder did not allocate in the slot is copied there
+    if (image != nullptr && image != slotPointer) {
+        memcpy(slotPointer, image, textureBytes(i));
+        stbi_image_free(image);
+    }
+    textureDecodeTimes[i] = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    if (image == nullptr)
+        std::cerr << "cannot decode " << textureFiles[i] << ": " << stbi_failure_reason() << std::endl;
+    return image != nullptr;
+}
 
-    // setup indices
-    cubesIndices = new GLuint[cubesSize * numberOfCubeSubbuffers];
+// decodes texture i into slot i at startup, before any upload
+void decodeTexture(unsigned int i) {
+    const bool decoded = decodeTextureToSlot(i, i);
+    handler.textures[i] = decoded ? textureStorePointer + textureSlotSize * i : nullptr;
+    textureInSlot[i] = decoded ? int(i) : -1;
+    textureSlotUploaded[i] = false;
+}
 
-    for (size_t i = 0; i < cubesSize * numberOfCubeSubbuffers; i++)
+// frees slots whose last upload is finished, textureRingMutex is held and a context is current
+void releaseTextureSlots() {
+    bool released = false;
+    for (size_t slot = 0; slot < textureRingSlots; slot++)
     {
-        cubesIndices[i] = i;
+        if (textureSlotFence[slot] == nullptr)
+            continue;
+        const GLenum result = glClientWaitSync(textureSlotFence[slot], 0, 0);
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+            glDeleteSync(textureSlotFence[slot]);
+            textureSlotFence[slot] = nullptr;
+            released = true;
+        }
     }
+    if (released)
+        textureSlotReleased.notify_all();
+}
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, handler.models[1].elementBufferObject);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, numberOfCubeSubbuffers * cubesSize * sizeof(GLuint), cubesIndices, GL_STATIC_DRAW);
-    delete[] cubesIndices;
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    CHECK_GL_ERROR();
+// uploads texture i from its slot to its texture and fences the slot, the store is bound as the pixel unpack buffer
+// a texture that is not decoded in the ring is not uploaded, the upload never waits for the decoder
+bool uploadTextureFromRing(unsigned int i) {
+    std::lock_guard<std::mutex> lock(textureRingMutex);
+    releaseTextureSlots();
+    unsigned int slot = 0;
+    while (slot < textureRingSlots && textureInSlot[slot] != int(i))
+        slot++;
+    if (slot == textureRingSlots)
+        return false;
+    glTextureSubImage2D(handler.GPUtextures[i], 0, 0, 0, handler.widths[i], handler.heights[i], GL_RGB, GL_UNSIGNED_BYTE, (void*)(textureSlotSize * slot));
+    // an unfinished upload of the slot from the other context is not covered by the new fence
+    if (textureSlotFence[slot] != nullptr) {
+        glClientWaitSync(textureSlotFence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(textureSlotFence[slot]);
+    }
+    // the fence is flushed, so the other context and releaseTextureSlots see it signaled
+    textureSlotFence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    textureSlotUploaded[slot] = true;
+    return true;
 }
 
-void fillCubeArray(GLfloat* newCubes) {
-    for (size_t z = 0; z < nCubesDepth; z++)
+// decodes the textures following the first textureRingSlots ones into the slots in rotation, the draw path never decodes
+// a slot is reused after its texture was uploaded at least once and the fence of its last upload is signaled
+void textureDecodeLoop() {
+    for (unsigned long long next = textureRingSlots; ; next++)
     {
-        for (size_t y = 0; y < nCubesRow; y++)
+        const unsigned int slot = next % textureRingSlots;
+        const unsigned int texture = next % handler.nTextures;
         {
-            for (size_t x = 0; x < nCubesCol; x++)
-            {
-                for (size_t i = 0; i < nCubeTriangles / 3; i++)
-                {
-
-                    glm::vec3 norm;
-                    glm::vec3 first(cubeVertices[3 * i], cubeVertices[3 * i + 1], cubeVertices[3 * i + 2]);
-                    glm::vec3 second(cubeVertices[3 * i + 3], cubeVertices[3 * i + 1 + 3], cubeVertices[3 * i + 2 + 3]);
-                    glm::vec3 third(cubeVertices[3 * i + 6], cubeVertices[3 * i + 1 + 6], cubeVertices[3 * i + 2 + 6]);
-                    glm::vec3 A = second - first; // edge 0 
-                    glm::vec3 B = third - first; // edge 1 
-                    norm = cross(A, B); // this is the triangle's normal 
-                    normalize(norm);
-                    for (size_t j = 0; j < 3; j++)
-                    {
-                        newCubes[(i * 3 + j + (x + y * nCubesCol + z * nCubesCol * nCubesRow) * nCubeTriangles) * 8] = cubeVertices[3 * (i * 3 + j)] + diff * x;            // pos x
-                        newCubes[(i * 3 + j + (x + y * nCubesCol + z * nCubesCol * nCubesRow) * nCubeTriangles) * 8 + 1] = cubeVertices[3 * (i * 3 + j) + 1] + diff * y;    // pos y
-                        newCubes[(i * 3 + j + (x + y * nCubesCol + z * nCubesCol * nCubesRow) * nCubeTriangles) * 8 + 2] = cubeVertices[3 * (i * 3 + j) + 2] + diff * z;    // pos z
-                        newCubes[(i * 3 + j + (x + y * nCubesCol + z * nCubesCol * nCubesRow) * nCubeTriangles) * 8 + 3] = 0;                // tex u
-                        newCubes[(i * 3 + j + (x + y * nCubesCol + z * nCubesCol * nCubesRow) * nCubeTriangles) * 8 + 4] = 0;                // tex v
-
-                        newCubes[(i * 3 + j + (x + y * nCubesCol + z * nCubesCol * nCubesRow) * nCubeTriangles) * 8 + 5] = norm.x;                // norm x
-                        newCubes[(i * 3 + j + (x + y * nCubesCol + z * nCubesCol * nCubesRow) * nCubeTriangles) * 8 + 6] = norm.y;                // norm y
-                        newCubes[(i * 3 + j + (x + y * nCubesCol + z * nCubesCol * nCubesRow) * nCubeTriangles) * 8 + 7] = norm.z;                // norm z
-                    }
-                }
-            }
+            std::unique_lock<std::mutex> lock(textureRingMutex);
+            textureSlotReleased.wait(lock, [slot] {
+                return end || textureInSlot[slot] < 0 || (textureSlotUploaded[slot] && textureSlotFence[slot] == nullptr);
+            });
+            if (end)
+                return;
+            if (textureInSlot[slot] >= 0)
+                handler.textures[textureInSlot[slot]] = nullptr;
+            textureInSlot[slot] = -1;
         }
+        const bool decoded = decodeTextureToSlot(texture, slot);
+        std::lock_guard<std::mutex> lock(textureRingMutex);
+        handler.textures[texture] = decoded ? textureStorePointer + textureSlotSize * slot : nullptr;
+        textureInSlot[slot] = decoded ? int(texture) : -1;
+        textureSlotUploaded[slot] = false;
     }
 }
 
-void initializeApplication() {
+// waits until every texture is decoded and creates the textures on the GPU, nothing textured is drawn before
+void createDecodedTextures(workerPool& decodePool) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    decodePool.wait();
+    const double waited = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
 
-    // load textures to ram
-    int tmp;
-    handler.textures[0] = stbi_load("tex1.jpg", &(handler.widths[0]), &(handler.heights[0]), &tmp, 0);
-    handler.textures[1] = stbi_load("tex2.jpg", &(handler.widths[1]), &(handler.heights[1]), &tmp, 0);
-    handler.textures[2] = stbi_load("tex3.jpg", &(handler.widths[2]), &(handler.heights[2]), &tmp, 0);
-    handler.textures[3] = stbi_load("tex4.jpg", &(handler.widths[3]), &(handler.heights[3]), &tmp, 0);
-    handler.textures[4] = stbi_load("tex5.jpg", &(handler.widths[4]), &(handler.heights[4]), &tmp, 0);
-    handler.textures[5] = stbi_load("tex6.jpg", &(handler.widths[5]), &(handler.heights[5]), &tmp, 0);
+    double decoding = 0.0;
+    for (size_t i = 0; i < textureRingSlots; i++)
+    {
+        if (handler.textures[i] == nullptr)
+            exit(EXIT_FAILURE);
+        std::cout << "  " << textureFiles[i] << " decoded in " << textureDecodeTimes[i] << " s" << std::endl;
+        decoding += textureDecodeTimes[i];
+    }
+    std::cout << textureRingSlots << " textures decoded on " << decodePool.size() << " threads, " << decoding << " s of decoding, " << waited << " s waited" << std::endl;
 
-    // generate textures in GPU
+    // generate textures in GPU, textures not in the ring get their content at their first upload
+    // rows of RGB images are not padded to 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glGenTextures(handler.nTextures, handler.GPUtextures);
     for (size_t i = 0; i < handler.nTextures; i++)
     {
@@ -623,8 +1851,30 @@ void initializeApplication() {
         // set texture filtering parameters
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, handler.widths[0], handler.heights[0], 0, GL_RGB, GL_UNSIGNED_BYTE, handler.textures[3]);
+        // a decoded texture is read from its slot of the store, the others are only allocated
+        if (handler.textures[i] != nullptr) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, textureStore);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, handler.widths[i], handler.heights[i], 0, GL_RGB, GL_UNSIGNED_BYTE, (void*)(textureSlotSize * i));
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, handler.widths[i], handler.heights[i], 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
     }
+    // the decoder may reuse the slots after their first upload, which can be in the other context
+    glFinish();
+
+    // with fewer slots than textures, the following textures are decoded while the first ones are drawn
+    if (textureRingSlots < handler.nTextures)
+        textureDecodeThread = std::thread(textureDecodeLoop);
+}
+
+void initializeApplication() {
+
+    // load the textures that fit to the texture ring on other threads, shaders are compiled and models added meanwhile
+    if (!createTextureStore())
+        exit(EXIT_FAILURE);
+    workerPool decodePool(std::min<unsigned int>(textureRingSlots, std::max(1u, std::thread::hardware_concurrency())));
+    decodePool.dispatch(textureRingSlots, decodeTexture);
 
     // create shaders
     GLuint shaders[] = {
@@ -642,6 +1892,33 @@ void initializeApplication() {
     handler.vmMatrix = glGetUniformLocation(handler.program, "vmMatrix");
     handler.nMatrix = glGetUniformLocation(handler.program, "nMatrix");
     handler.useEmissionTexture = glGetUniformLocation(handler.program, "useEmissionTexture");
+    handler.usePackedVertices = glGetUniformLocation(handler.program, "usePackedVertices");
+    handler.packedChunkGrid = glGetUniformLocation(handler.program, "packedChunkGrid");
+    handler.packedChunkExtent = glGetUniformLocation(handler.program, "packedChunkExtent");
+    handler.packedPositionScale = glGetUniformLocation(handler.program, "packedPositionScale");
+    handler.useProceduralCubes = glGetUniformLocation(handler.program, "useProceduralCubes");
+    handler.proceduralGrid = glGetUniformLocation(handler.program, "proceduralGrid");
+    handler.proceduralSpacing = glGetUniformLocation(handler.program, "proceduralSpacing");
+    handler.useImpostors = glGetUniformLocation(handler.program, "useImpostors");
+    handler.impostorPointScale = glGetUniformLocation(handler.program, "impostorPointScale");
+
+    // compute program is optional, it needs OpenGL 4.3
+    GLint majorVersion = 0, minorVersion = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+    glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+    handler.computeProgram = 0;
+    if (majorVersion > 4 || (majorVersion == 4 && minorVersion >= 3)) {
+        GLuint computeShaders[] = {
+                pgr::createShaderFromFile(GL_COMPUTE_SHADER, "cubecs.glsl"),
+                0,
+        };
+        if (computeShaders[0] != 0)
+            handler.computeProgram = pgr::createProgram(computeShaders);
+        handler.computeFirstCube = glGetUniformLocation(handler.computeProgram, "firstCube");
+        handler.computeCubeCount = glGetUniformLocation(handler.computeProgram, "cubeCount");
+        handler.computeGrid = glGetUniformLocation(handler.computeProgram, "grid");
+        handler.computeSpacing = glGetUniformLocation(handler.computeProgram, "spacing");
+    }
 
     handler.position = glGetAttribLocation(handler.program, "position");
     handler.normal = glGetAttribLocation(handler.program, "normal");
@@ -662,20 +1939,93 @@ void initializeApplication() {
     cam.setPosition(glm::vec3(-9.0f, 0.9f, 10.0f));
     cam.setDirection(glm::vec3(0.640737712, -0.0359922871, -0.766915500));
     cam.setUpVector(glm::vec3(0, 1, 0));
+    // both published steps start at the initial camera
+    publishedCamera.publish(cam, glfwGetTime());
+    publishedCamera.publish(cam, glfwGetTime());
 
     glUseProgram(handler.program);
 
+    // choose the cube generator before the first cubes are computed
+    if (!selectCubeArrayFiller())
+        exit(EXIT_FAILURE);
+    startFillPool();
+
+    // shares of parts are ranges of whole cubes, faces and levels of detail need a count of every cube first
+    if (uploadContexts > 1 && (visibleFacesOnly || impostorDistance > 0.0f || incrementalUpdates)) {
+        std::cerr << "more upload contexts are not used with visible faces, levels of detail or incremental updates" << std::endl;
+        uploadContexts = 1;
+    }
+    allocateCubeRingState();
+
+    if (chunkStreamingRadius > 0.0f) {
+        residency = new chunkResidency(nCubesCol, nCubesRow, nCubesDepth, cubeSpacing, 1.0f, chunkStreamingRadius);
+        std::cout << "chunk streaming: pool of " << residency->slotCount() << " slots of " << chunkResidency::chunkCubes << "^3 cubes, "
+            << residency->slotCount() * chunkSlotSize() / (1024 * 1024) << " MB" << std::endl;
+    }
+
     addModels();
 
+    createDecodedTextures(decodePool);
+
+    if (benchmarkStores) {
+        runStoreBenchmark();
+        exit(EXIT_SUCCESS);
+    }
+
+    // culled parts of the buffer and visible faces depend on the camera, so they are always written whole
+    if ((frustumCulling || visibleFacesOnly || impostorDistance > 0.0f) && incrementalUpdates) {
+        std::cerr << "incremental updates are not used with frustum culling, visible faces or levels of detail" << std::endl;
+        incrementalUpdates = false;
+    }
+    if (frustumCulling) {
+        culler = new brickCuller(nCubesCol, nCubesRow, nCubesDepth, cubeSpacing, 1.0f, std::min(simd::detect(), maxSimdLevel));
+        std::cout << "frustum culling of " << culler->totalBricks() << " bricks" << std::endl;
+    }
+
+    // parts of the buffer were never filled or were filled before the scene started changing
+    if (incrementalUpdates)
+        markCubesDirty(0, nCubes);
+
+    // chunk layout of packed vertices never changes
+    glUniform2i(handler.packedChunkGrid, (nCubesCol + packedChunkCubes - 1) / packedChunkCubes, (nCubesRow + packedChunkCubes - 1) / packedChunkCubes);
+    glUniform1f(handler.packedChunkExtent, packedChunkExtent);
+    glUniform1f(handler.packedPositionScale, float(packedPositionScale));
+
     glClearColor(0, 0, 0, 1.0f);
 
+    // size of point sprites of far cubes is computed in the vertex shader
+    glEnable(GL_PROGRAM_POINT_SIZE);
     glEnable(GL_DEPTH_TEST);
     CHECK_GL_ERROR();
 }
 
 static void update_scene(double time) {
     cam.update(time);
+    if (incrementalUpdates)
+        changeRandomCubes();
+
+}
 
+// updates the scene in steps of simulationStep until the application ends, stalls of drawing or streaming do not change the steps
+void simulationThreadLoop() {
+    double simulated = glfwGetTime();
+    while (!end) {
+        const double now = glfwGetTime();
+        // a late thread catches up by several steps, the mouse movement is applied in the first of them
+        while (simulated + simulationStep <= now) {
+            {
+                std::lock_guard<std::mutex> lock(mouseMovementMutex);
+                handler.mouseDx = int(mouseMovementX);
+                handler.mouseDy = int(mouseMovementY);
+                mouseMovementX -= handler.mouseDx;
+                mouseMovementY -= handler.mouseDy;
+            }
+            update_scene(simulationStep);
+            simulated += simulationStep;
+            publishedCamera.publish(cam, simulated);
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(simulated + simulationStep - glfwGetTime()));
+    }
 }
 
 static void error_callback(int error, const char* description)
@@ -687,64 +2037,110 @@ static void eraseLastBufferMethod(const unsigned char& lastBufferMethod) {
     switch (lastBufferMethod) {
     case 0:
     case 1:
+    case 5:
+    case 6:
         // Nothing needs to be changed
         break;
     case 2:
-        // the buffer is mapped in method 2
+        // the thread may wait for a mapped part
+        bufferThreadEnd = true;
+        ringPartsReleased.wake();
+        framePacing.wake();
+        bufferThread.join();
+        bufferThreadEnd = false;
+        // the buffer is mapped in method 2, it is unmapped after the thread stopped writing to it
+        glBindBuffer(GL_ARRAY_BUFFER, handler.models[1].vertexBufferObject);
         glUnmapBuffer(GL_ARRAY_BUFFER);
         CHECK_GL_ERROR();
+        break;
+    case 3:
+    case 4:
+        // the thread may wait for a drawn part
         bufferThreadEnd = true;
-        // thread that is ending is blocked by this mutex so we need to unlock it
-        secondMethodMutexData[cubeDrawingIndex].unlock();
-        // end the thread
+        ringPartsReleased.wake();
+        framePacing.wake();
         bufferThread.join();
+        stopUploadHelpers();
         bufferThreadEnd = false;
+        // methods 0-2 map parts of the ring themselves
+        if (lastBufferMethod == 3)
+            cubeRing->unmap();
         break;
-    case 3:
-        // we need to end the thread
+    case 7:
+        // the thread may wait for a draw
         bufferThreadEnd = true;
-        // this unlocks all the mutexes that block the the thread
-        drawCubesMethod3();
-        // end the thread
+        chunkDrawnCondition.notify_one();
+        framePacing.wake();
         bufferThread.join();
         bufferThreadEnd = false;
-        // this mutex is locked by ended thread
-        thidMethodMutex[cubeDrawingIndex].unlock();
         break;
     }
 }
 
 void secondMethodThread();
-void thirdMethodThread();
+void thirdMethodThread(unsigned char method);
+void uploadHelperThread(unsigned int context);
+void chunkStreamingThread();
 
 static void startBufferMethod(const unsigned char& newBufferMethod) {
     switch (newBufferMethod) {
     case 0:
     case 1:
-        // Nothing needs to be changed
+    case 5:
+    case 6:
+        glBindVertexArray(cubeVertexArray(newBufferMethod));
         break;
     case 2:
         // map buffer and start thread
         glBindVertexArray(handler.models[1].vertexArrayObject);
         glBindBuffer(GL_ARRAY_BUFFER, handler.models[1].vertexBufferObject);
         // map first buffer so the second thread can start copying data
-        cubesMappedPointer = (GLfloat*)glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(GLfloat) * cubesSize * 8, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        cubesMappedIndex = 0;
+        cubesMappedPointer = glMapBufferRange(GL_ARRAY_BUFFER, 0, cubeSubbufferSize(), GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        ringPartsFilled.reset(0);
+        ringPartsReleased.reset(1);
 
-        secondMethodMutexData[numberOfCubeSubbuffers - 1].lock();
         bufferThread = std::thread(secondMethodThread);
         break;
     case 3:
-        thidMethodMutex[numberOfCubeSubbuffers - 1].lock();
-        // set init sync objects(wait/delete would call an error if the object does not exist)
+    case 4:
+        glBindVertexArray(cubeVertexArray(newBufferMethod));
+        // the producer writes slots of the ring through one mapping kept while the method runs
+        if (newBufferMethod == 3)
+            cubeRing->map();
+        // parts filled before the first draw are ready without any upload
         for (size_t i = 0; i < numberOfCubeSubbuffers; i++)
         {
-            thirdMethodSyncUploadStart[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-            thirdMethodSyncUploadEnd[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-
+            if (thirdMethodSyncUploadStart[i] != nullptr)
+                glDeleteSync(thirdMethodSyncUploadStart[i]);
+            if (thirdMethodSyncUploadEnd[i] != nullptr)
+                glDeleteSync(thirdMethodSyncUploadEnd[i]);
+            thirdMethodSyncUploadStart[i] = nullptr;
+            thirdMethodSyncUploadEnd[i] = nullptr;
+        }
+        for (GLsync& fence : helperSyncUploadEnd)
+        {
+            if (fence != nullptr)
+                glDeleteSync(fence);
+            fence = nullptr;
+        }
+        ringPartsFilled.reset(numberOfCubesPreComputed);
+        ringPartsReleased.reset(0);
+
+        // helpers fill their shares of parts of the ring in their own contexts
+        if (newBufferMethod == 3) {
+            uploadJobs.reset(0);
+            uploadSharesDone.reset(0);
+            for (unsigned int context = 1; context < uploadContexts; context++)
+                uploadHelpers.emplace_back(uploadHelperThread, context);
         }
 
-        // start thread
-        bufferThread = std::thread(thirdMethodThread);
+        // start thread, the method is passed because bufferMethod is changed after the thread starts
+        bufferThread = std::thread(thirdMethodThread, newBufferMethod);
+        break;
+    case 7:
+        glBindVertexArray(cubeVertexArray(newBufferMethod));
+        bufferThread = std::thread(chunkStreamingThread);
         break;
     }
     cubeDrawingIndex = numberOfCubeSubbuffers - 1;
@@ -753,9 +2149,23 @@ static void startBufferMethod(const unsigned char& newBufferMethod) {
 static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
     // change buffer method
-    if ((key >= '0') && key <= '3' && action == GLFW_RELEASE) {
+    if ((key >= '0') && key <= '7' && action == GLFW_RELEASE) {
         changeMethod = true;
         newMethod = key - '0';
+        // compute shaders write only the layout of 8 floats
+        if (newMethod == 6 && (handler.computeProgram == 0 || packedVertices)) {
+            std::cout << "compute method needs OpenGL 4.3 and unpacked vertices" << std::endl;
+            changeMethod = false;
+        }
+        // with chunk streaming the buffer of the whole grid is not allocated
+        if (residency != nullptr && (newMethod <= 3 || newMethod == 6)) {
+            std::cout << "methods 0-3 and 6 are not available with chunk streaming" << std::endl;
+            changeMethod = false;
+        }
+        if (residency == nullptr && newMethod == 7) {
+            std::cout << "chunk streaming method needs -chunk-streaming" << std::endl;
+            changeMethod = false;
+        }
     }
 
     // change texture method
@@ -767,7 +2177,7 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
     if ((key == 'q' || key == 'Q') && action == GLFW_RELEASE) {
         drawTextures = !drawTextures;
         thisFrameIndex = 0;
-        glBindVertexArray(handler.models[!drawTextures].vertexArrayObject);
+        glBindVertexArray(drawTextures ? handler.models[0].vertexArrayObject : cubeVertexArray(bufferMethod));
     }
 
 
@@ -787,33 +2197,9 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
     }
 }
 
-void copyDataToPBO(unsigned int index) {
-    // binding pbo for the first data transfer
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[curPBO]); //bind pbo
-
-    // map the pbo 
-    GLubyte* ptr = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, handler.widths[0] * handler.heights[0] * sizeof(unsigned char) * 3, GL_MAP_WRITE_BIT);
-
-    // copy
-    memcpy(ptr, handler.textures[index], handler.widths[0] * handler.heights[0] * sizeof(unsigned char) * 3);
-    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-    CHECK_GL_ERROR();
-}
-
 void getDataFromPBOToTexture(unsigned int index) {
-    // bind specific PBO
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[1 - curPBO]); 
-
-    // get data from bound buffer to the texture
-    glTextureSubImage2D(handler.GPUtextures[index], 0, 0, 0, handler.widths[0], handler.heights[0], GL_RGB, GL_UNSIGNED_BYTE, (void*)(0));
-    CHECK_GL_ERROR();
-}
-
-void generateNewPBO(unsigned int index) {
-
-    glGenBuffers(1, &pbo[index]);
-    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo[index]); //bind pbo
-    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, handler.widths[0] * handler.heights[0] * sizeof(unsigned char) * 3, NULL, GL_MAP_WRITE_BIT);
+    // the upload reads the texture from its slot of the ring, a texture the decoder has not reached keeps its last content
+    uploadTextureFromRing(index);
     CHECK_GL_ERROR();
 }
 
@@ -824,27 +2210,15 @@ void textureAsyncThread() {
     // lock first texture, because we have to preload textures and this blocks the other thread
     startUploadMutex[0].lock();
 
-    // creating first pbo
-    generateNewPBO(0);
-
-    // creating second pbo
-    generateNewPBO(1);
-
-    // copy first texture data to the GPU
-    copyDataToPBO(0);
-    curPBO = 1 - curPBO;
+    // uploads of this context read the texture store
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, textureStore);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
     int i = 0;
     for (; i < preloadedTextures; i++)
     {
-        // copy data from CPU to PBO on GPU
-        copyDataToPBO((i + 1) % handler.nTextures);
-
-        // get data from the pbo, we filled with data in last iteration, to texture
+        // get data from the store to texture
         getDataFromPBOToTexture(i);
-
-        // update PBO index
-        curPBO = 1 - curPBO;
     }
 
     // unlock mutex that kept drawing thread from drawing unprepared textures
@@ -867,10 +2241,7 @@ void textureAsyncThread() {
         glWaitSync(startUpload[i], 0, GL_TIMEOUT_IGNORED);
         glDeleteSync(startUpload[i]);
 
-        // copying data of a texture to pbo
-        copyDataToPBO((i + 1) % handler.nTextures);
-       
-        // copying from PBO, we copied data to in last iteration, to texture
+        // copying from the store to texture
         getDataFromPBOToTexture(i);
 
         // setup the openGL sync object, for the other thread to know when the copying of data to textures is done
@@ -879,7 +2250,6 @@ void textureAsyncThread() {
 
         // update indices
         i = (i + 1) % handler.nTextures;
-        curPBO = 1 - curPBO;
 
     }
     // unlock the lock, which is locked by last iteration
@@ -888,111 +2258,216 @@ void textureAsyncThread() {
     glfwMakeContextCurrent(NULL);
 }
 
-void update(double &lastTime) {
-    double currentTime = glfwGetTime();
-        // setup camera
-        double oldMouseX = handler.mouseX, oldMouseY = handler.mouseY;
-        glfwGetCursorPos(handler.window, &(handler.mouseX), &(handler.mouseY));
-        handler.mouseDx = -handler.mouseX + oldMouseX;
-        handler.mouseDy = -handler.mouseY + oldMouseY;
+void secondMethodThread() {
+    unsigned long long part = ringPartsFilled.load();
+    unsigned long long frame = framePacing.frame();
+    while (!vertexThreadStopping()) {
+        // wait until the main thread maps the next part of the buffer
+        if (!ringPartsReleased.waitFor(part + 1, vertexThreadStopping))
+            break;
+
+        // send data to mapped part of a buffer, the whole mapped range is flushed by unmapping
+        fillCubeSubbuffer(cubesMappedPointer, cubesMappedIndex, false);
+
+        // tell the other thread that the data of this part has been copied
+        ringPartsFilled.increase();
+        part++;
 
-        secondMethodMutexCamera.lock();
-        update_scene(currentTime - lastTime);
-        lastTime = currentTime;
-        secondMethodMutexCamera.unlock();
+        // the next part is filled in the next frame
+        if (!framePacing.waitForNextFrame(frame, vertexThreadStopping))
+            break;
+    }
 }
 
-void secondMethodThread() {
-    // this mutex is going to be unlocked in the beginning of the first iteration of the following cycle
-    secondMethodMutexData[numberOfCubeSubbuffers - numberOfCubesPreComputed].lock();
+// streams cube vertices (method 3) or cube offsets for instanced drawing (method 4)
+void thirdMethodThread(unsigned char method) {
+
+    glfwMakeContextCurrent(handler.bufferContextWindow);
 
-    // CPU time to be used by update method(move of camera is dependent on delta time 
-    double lastTime = glfwGetTime();
+    unsigned long long part = ringPartsFilled.load();
+    unsigned long long frame = framePacing.frame();
+    while (!vertexThreadStopping()) {
+        // stay numberOfCubesPreComputed parts ahead of the drawn part, the part filled numberOfCubeSubbuffers parts ago was drawn then
+        if (part >= numberOfCubesPreComputed && !ringPartsReleased.waitFor(part - numberOfCubesPreComputed, vertexThreadStopping))
+            break;
+        const unsigned int index = part % numberOfCubeSubbuffers;
+
+        if (method == 4) {
+            // wait for the drawing, of the part of buffer we are going to change, to end
+            if (thirdMethodSyncUploadStart[index] != nullptr) {
+                glWaitSync(thirdMethodSyncUploadStart[index], 0, GL_TIMEOUT_IGNORED);
+                glDeleteSync(thirdMethodSyncUploadStart[index]);
+                thirdMethodSyncUploadStart[index] = nullptr;
+            }
 
-    unsigned int index = numberOfCubeSubbuffers - numberOfCubesPreComputed;
-    while (!end && !bufferThreadEnd) {
-        // update scene
-        update(lastTime);
-        
-        // send data to mapped part of a buffer	   	
-        fillCubeArray(cubesMappedPointer);
+            // map a part of the offset buffer and fill it with an offset of every cube
+            glBindBuffer(GL_ARRAY_BUFFER, handler.models[2].instanceBufferObject);
+            GLfloat* offsets = (GLfloat*)glMapBufferRange(GL_ARRAY_BUFFER, instanceSubbufferSize() * index, instanceSubbufferSize(), GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            fillCubeInstances(offsets, index);
 
-        // tell the other thread that the data from this index has been copied
-        secondMethodMutexData[index].unlock();
+            // unmap the part of buffer we were using
+            if (glUnmapBuffer(GL_ARRAY_BUFFER) != GL_TRUE) {
+                std::cout << "ERROR\n";
+            }
+        }
+        else {
+            // the ring stays mapped, the slot is returned when the GPU finished drawing it
+            // fill the slot with cube data, coherent mapping needs no flushes
+            if (uploadContexts > 1)
+                fillCubeSubbufferShared(cubeRing->acquire(index), index);
+            else
+                fillCubeSubbuffer(cubeRing->acquire(index), index, false);
+        }
+
+        // setup the openGL sync object, for the other thread to know when the copying of data to current part of buffer is done
+        thirdMethodSyncUploadEnd[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        CHECK_GL_ERROR();
 
-        //update index
-        index = (index + 1) % numberOfCubeSubbuffers;
+        // the fence is published together with the part
+        ringPartsFilled.increase();
+        part++;
 
-        // tell the other thread that the data from this index is about to be change and therfore the other thread cannot use this data
-        secondMethodMutexData[index].lock();
+        // parts filled before the first draw keep the producer ahead, it fills one more part every frame
+        if (!framePacing.waitForNextFrame(frame, vertexThreadStopping))
+            break;
     }
 
-    // unlock the mutex that was locked in the last iteration
-    secondMethodMutexData[index].unlock();
+    glfwMakeContextCurrent(NULL);
 }
 
-void thirdMethodThread() {
+// writes the share of the last job of the context with index "context", 0 is the context of bufferContextWindow
+void fillUploadShare(unsigned int context) {
+    fillCubeRunsPart(uploadJobPointer, uploadJobRuns, uploadJobCubes * context / uploadContexts, uploadJobCubes * (context + 1) / uploadContexts,
+        cubeArrayFiller, cubeVertexSize() * nCubeTriangles);
+}
 
-    glfwMakeContextCurrent(handler.bufferContextWindow);
+// fills a part of the ring by all upload contexts, each of them writes the same number of cubes (method 3)
+void fillCubeSubbufferShared(void* mapped, unsigned int index) {
+    if (culler != nullptr) {
+        uploadJobCubes = cullCubes();
+        uploadJobRuns = visibleCubeRuns;
+    }
+    else {
+        uploadJobRuns.assign(1, std::make_pair(size_t(0), size_t(nCubes)));
+        uploadJobCubes = nCubes;
+    }
+    subbufferCubes[index] = uploadJobCubes;
+    subbufferVertices[index] = uploadJobCubes * nCubeTriangles;
+    subbufferImpostors[index] = 0;
+    subbufferDroppedCubes[index] = 0;
+
+    // the job is published to helpers by the counter
+    uploadJobPointer = mapped;
+    uploadJobIndex = index;
+    uploadJobs.increase();
+    fillUploadShare(0);
+
+    // fences of all shares are set when every helper is done
+    uploadSharesDone.waitFor(uploadJobs.load() * (uploadContexts - 1), vertexThreadStopping);
+}
 
-    // this mutex is going to be unlocked in the end of the first iteration of the following cycle. 
-    // prevents the other thread from drawing from the part of buffer that is currently mapped in this thread
-    thidMethodMutex[numberOfCubeSubbuffers - numberOfCubesPreComputed].lock();
+// fills shares of parts of the ring in its own context
+void uploadHelperThread(unsigned int context) {
 
-    // CPU time to be used by update method(move of camera is dependent on delta time 
-    double lastTime = glfwGetTime();
+    glfwMakeContextCurrent(handler.uploadContextWindows[context - 1]);
 
-    unsigned int index = numberOfCubeSubbuffers - numberOfCubesPreComputed;
-    while (!end && !bufferThreadEnd) {
-        // update scene
-        update(lastTime);
+    unsigned long long job = uploadJobs.load();
+    while (uploadJobs.waitFor(job + 1, vertexThreadStopping)) {
+        job++;
+        fillUploadShare(context);
 
-        // wait for the drawing, of the part of buffer we are going to change, to end
-        glWaitSync(thirdMethodSyncUploadStart[index], 0, GL_TIMEOUT_IGNORED);
-        glDeleteSync(thirdMethodSyncUploadStart[index]);
+        // the main thread waits for this fence before it draws the part
+        helperSyncUploadEnd[uploadJobIndex * (uploadContexts - 1) + context - 1] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
 
-        // bind buffer that we are going to map and copy data to
-        glBindBuffer(GL_ARRAY_BUFFER, handler.models[1].vertexBufferObject);
+        uploadSharesDone.increase();
+    }
 
-        // map a part of buffer that we are going to fill with new data
-        cubesMappedPointer = (GLfloat*)glMapBufferRange(GL_ARRAY_BUFFER, sizeof(GLfloat) * cubesSize * 8 * index, sizeof(GLfloat) * cubesSize * 8, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
-        
-        // fill the mapped the part of buffer with cube data
-        fillCubeArray(cubesMappedPointer);
+    glfwMakeContextCurrent(NULL);
+}
 
-        // unmap the part of buffer we were using
-        if (glUnmapBuffer(GL_ARRAY_BUFFER) != GL_TRUE) {
-            std::cout << "ERROR\n";
-        }
+// joins helpers of method 3, bufferThreadEnd or end has to be set
+void stopUploadHelpers() {
+    uploadJobs.wake();
+    uploadSharesDone.wake();
+    for (std::thread& helper : uploadHelpers)
+        helper.join();
+    uploadHelpers.clear();
+}
 
-        // setup the openGL sync object, for the other thread to know when the copying of data to current part of buffer is done
-        thirdMethodSyncUploadEnd[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-        CHECK_GL_ERROR();
+// keeps chunks around the camera resident in the pool of chunk slots (method 7)
+void chunkStreamingThread() {
 
-        // tell the other thread that part of buffer with index "index" is unmapped
-        thidMethodMutex[index].unlock();
+    glfwMakeContextCurrent(handler.bufferContextWindow);
+
+    std::vector<std::pair<unsigned int, unsigned int>> loads;
+    std::vector<std::pair<size_t, size_t>> runs;
+    const size_t cubeBytes = cubeVertexSize() * nCubeTriangles;
+    unsigned long long drawnVersion = 0;
+    unsigned long long publishedVersion = 0;
+    unsigned long long frame = framePacing.frame();
+    while (!end && !bufferThreadEnd) {
+        const unsigned long long version = residency->update(cameraPosition(), drawnVersion, chunkLoadsPerUpdate, loads);
+        if (version != publishedVersion) {
+            // loaded chunks get free slots, no draw reads them
+            for (const std::pair<unsigned int, unsigned int>& load : loads)
+            {
+                const size_t cubes = residency->chunkRuns(load.first, runs);
+                fillCubeRuns((GLubyte*)chunkPoolPointer + load.second * chunkSlotSize(), runs, cubes, cubeArrayFiller, cubeBytes);
+            }
 
-        index = (index + 1) % numberOfCubeSubbuffers;
-        // tell the other thread that it cannot draw from part of the buffer, because we are going to copy new data into it
-        thidMethodMutex[index].lock();
+            chunkDrawList list;
+            for (unsigned int chunk : residency->resident())
+            {
+                list.chunks.push_back(chunk);
+                list.firsts.push_back(GLint(residency->slotOf(chunk) * chunkSlotSize() / cubeVertexSize()));
+                list.counts.push_back(GLsizei(residency->chunkRuns(chunk, runs) * nCubeTriangles));
+            }
+            list.version = version;
+            // the main thread waits for this fence before it draws the new slots
+            list.uploaded = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
 
-    }
+            {
+                std::lock_guard<std::mutex> lock(chunkDrawListMutex);
+                // a list that was not drawn yet is replaced by the newer one
+                if (chunkListPublished && publishedChunks.uploaded != nullptr)
+                    glDeleteSync(publishedChunks.uploaded);
+                publishedChunks = std::move(list);
+                chunkListPublished = true;
+            }
+            publishedVersion = version;
+        }
+
+        // wait for the next draw, slots evicted before the drawn version are free when the GPU finishes it
+        GLsync drawn = nullptr;
+        unsigned long long drawnFenceVersion = 0;
+        {
+            std::unique_lock<std::mutex> lock(chunkDrawListMutex);
+            chunkDrawnCondition.wait_for(lock, std::chrono::milliseconds(10), [] { return chunkDrawnFence != nullptr || end || bufferThreadEnd; });
+            drawn = chunkDrawnFence;
+            drawnFenceVersion = chunkDrawnVersion;
+            chunkDrawnFence = nullptr;
+        }
+        if (drawn != nullptr) {
+            GLenum result;
+            while ((result = glClientWaitSync(drawn, 0, 1000000)) == GL_TIMEOUT_EXPIRED && !end && !bufferThreadEnd);
+            if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+                drawnVersion = drawnFenceVersion;
+            glDeleteSync(drawn);
+        }
 
-    // This mutex was locked in last iteration of previous cycle
-    thidMethodMutex[index].unlock();
+        // residency is updated once every frame
+        if (!framePacing.waitForNextFrame(frame, vertexThreadStopping))
+            break;
+    }
 
     glfwMakeContextCurrent(NULL);
 }
 
 // this method setup mutexes and locks for future usage of all methods
 void setupLocks() {
-    for (size_t i = 0; i < numberOfCubeSubbuffers; i++)
-    {
-        thirdMethodSyncUploadStart[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-        thirdMethodSyncUploadEnd[i] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-
-    }
-
 
     for (size_t i = 0; i < preloadedTextures; i++)
     {
@@ -1010,7 +2485,145 @@ void setupLocks() {
 
 }
 
+// value of the option at argv[i], the application ends if it is missing
+const char* optionValue(int argc, char* argv[], int& i) {
+    if (i + 1 >= argc) {
+        std::cerr << argv[i] << " needs a value" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return argv[++i];
+}
+
+// parses a whole number of an option from min to max, the application ends if the value is not one
+unsigned int parseUnsigned(const char* option, const char* value, unsigned int min, unsigned int max) {
+    char* valueEnd = nullptr;
+    errno = 0;
+    // strtoul accepts a minus sign and negates the number, so negative values would wrap to large ones
+    const unsigned long number = std::strtoul(value, &valueEnd, 10);
+    if (value[0] == '-' || valueEnd == value || *valueEnd != '\0' || errno == ERANGE || number < min || number > max) {
+        std::cerr << option << ": \"" << value << "\" is not a whole number from " << min << " to " << max << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return (unsigned int)number;
+}
+
+// parses a number of an option from min to max, the application ends if the value is not one
+double parseNumber(const char* option, const char* value, double min, double max) {
+    char* valueEnd = nullptr;
+    errno = 0;
+    const double number = std::strtod(value, &valueEnd);
+    if (valueEnd == value || *valueEnd != '\0' || errno == ERANGE || !(number >= min && number <= max)) {
+        std::cerr << option << ": \"" << value << "\" is not a number from " << min << " to " << max << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return number;
+}
+
+// reads settings from the command line, unknown arguments are reported and ignored, malformed values end the application
+void parseArguments(int argc, char* argv[]) {
+    const float maxDistance = 1e6f;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        const char* option = argv[i];
+        if (argument == "-fill-threads") {
+            fillThreads = parseUnsigned(option, optionValue(argc, argv, i), 0, 1024);
+        }
+        else if (argument == "-incremental") {
+            incrementalUpdates = true;
+        }
+        else if (argument == "-changed-cubes") {
+            changedCubesFraction = parseNumber(option, optionValue(argc, argv, i), 0.0, 1.0);
+        }
+        else if (argument == "-stores") {
+            const std::string stores = optionValue(argc, argv, i);
+            if (stores != "plain" && stores != "stream") {
+                std::cerr << option << ": \"" << stores << "\" is not plain or stream" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            streamingStores = stores == "stream";
+        }
+        else if (argument == "-benchmark-stores") {
+            benchmarkStores = true;
+        }
+        else if (argument == "-culling") {
+            frustumCulling = true;
+        }
+        else if (argument == "-visible-faces") {
+            visibleFacesOnly = true;
+        }
+        else if (argument == "-lod") {
+            impostorDistance = float(parseNumber(option, optionValue(argc, argv, i), 0.0, maxDistance));
+            lodDropDistance = float(parseNumber(option, optionValue(argc, argv, i), 0.0, maxDistance));
+            // near cubes must stay inside drawn cubes
+            if (lodDropDistance < impostorDistance)
+                lodDropDistance = impostorDistance;
+        }
+        else if (argument == "-chunk-streaming") {
+            chunkStreamingRadius = float(parseNumber(option, optionValue(argc, argv, i), 0.0, maxDistance));
+        }
+        else if (argument == "-ring-depth") {
+            // the grid limits the depth further when it is known
+            numberOfCubeSubbuffers = parseUnsigned(option, optionValue(argc, argv, i), 2, maxCubeRingDepth);
+        }
+        else if (argument == "-frame-budget") {
+            framePacing.setBudget(parseNumber(option, optionValue(argc, argv, i), 0.0, 1000.0) / 1000.0);
+        }
+        else if (argument == "-upload-contexts") {
+            uploadContexts = parseUnsigned(option, optionValue(argc, argv, i), 1, 64);
+        }
+        else if (argument == "-ring-prefill") {
+            numberOfCubesPreComputed = parseUnsigned(option, optionValue(argc, argv, i), 1, maxCubeRingDepth - 1);
+        }
+        else if (argument == "-texture-ring") {
+            textureRingSlots = parseUnsigned(option, optionValue(argc, argv, i), 1, handler.nTextures);
+        }
+        else if (argument == "-packed-vertices") {
+            packedVertices = true;
+        }
+        else if (argument == "-procedural-grid") {
+            // the vertex count of one draw call must fit to GLsizei
+            proceduralGridSize = parseUnsigned(option, optionValue(argc, argv, i), 0, 390);
+        }
+        else if (argument == "-grid") {
+            cubeGridSize = parseUnsigned(option, optionValue(argc, argv, i), 1, UINT_MAX);
+        }
+        else if (argument == "-simd") {
+            const std::string level = optionValue(argc, argv, i);
+            if (level == "reference")
+                useReferenceFiller = true;
+            else if (level == "scalar")
+                maxSimdLevel = simd::scalar;
+            else if (level == "sse2")
+                maxSimdLevel = simd::sse2;
+            else if (level == "avx")
+                maxSimdLevel = simd::avx;
+            else {
+                std::cerr << option << ": \"" << level << "\" is not reference, scalar, sse2 or avx" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        else {
+            std::cerr << "unknown argument: " << argument << std::endl;
+        }
+    }
+
+    // the benchmark measures the generator of methods 0-3 writing unpacked vertices to the buffer of the whole grid
+    if (benchmarkStores && (packedVertices || chunkStreamingRadius > 0.0f)) {
+        std::cerr << "-benchmark-stores cannot be used with " << (packedVertices ? "-packed-vertices" : "-chunk-streaming") << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // one part is drawn while at least one other is filled
+    if (numberOfCubesPreComputed >= numberOfCubeSubbuffers) {
+        std::cerr << "ring prefill is from 1 to ring depth - 1" << std::endl;
+        numberOfCubesPreComputed = numberOfCubeSubbuffers - 1;
+    }
+}
+
 int main(int argc, char* argv[]) {
+    parseArguments(argc, argv);
+
     glfwSetErrorCallback(error_callback);
 
     //ilInit(); UNCOMMENT IF DEVILL NEEDED
@@ -1058,13 +2671,19 @@ int main(int argc, char* argv[]) {
     // create a context for second thread in async vertex data transfer(method 2 and 3)
     glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
     handler.bufferContextWindow = glfwCreateWindow(640, 480, "Second Window", NULL, handler.window);
+    for (unsigned int i = 1; i < uploadContexts; i++)
+        handler.uploadContextWindows.push_back(glfwCreateWindow(640, 480, "Upload Window", NULL, handler.window));
 
     // create a context for second thread in async texture data transfer
     glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
     handler.textureContextWindow = glfwCreateWindow(640, 480, "Second Window", NULL, handler.window);
 
-    // prepare for calculating time on CPU
-    double lastTime = glfwGetTime();
+    // the whole grid is not in the buffer of methods 0-3, so cubes are streamed from the beginning
+    if (residency != nullptr) {
+        startBufferMethod(7);
+        bufferMethod = 7;
+    }
+
     unsigned int counter = 0;
     double averageTimePerFrame = 0;
 
@@ -1073,12 +2692,14 @@ int main(int argc, char* argv[]) {
 
     glBindVertexArray(handler.models[0].vertexArrayObject);
 
+    simulationThread = std::thread(simulationThreadLoop);
+
     while (!glfwWindowShouldClose(handler.window)) {
 
+        // wait for the scheduled start of the frame, producers start their work for it
+        framePacing.beginFrame();
+
         // collect info about draw time of current method
-        const double thisTime = glfwGetTime();
-        double diff = thisTime - lastTime;
-        lastTime = thisTime;
         unsigned int tmp;
         if (drawTextures)
             tmp = maxCounter * handler.nTextures;
@@ -1106,6 +2727,11 @@ int main(int argc, char* argv[]) {
 
             averageTimePerFrame /= tmp;
             std::cout << averageTimePerFrame << " s" << std::endl;
+            if (!drawTextures) {
+                reportSlabTimes();
+                reportVisibleCubes();
+            }
+            framePacing.report();
             averageTimePerFrame = 0;
             counter = 0;
             thisFrameIndex = 0;
@@ -1125,15 +2751,6 @@ int main(int argc, char* argv[]) {
             }
         }
 
-        // update scene for vertex methods without second thread
-        if (bufferMethod == 0 || bufferMethod == 1) {
-            double oldMouseX = handler.mouseX, oldMouseY = handler.mouseY;
-            glfwGetCursorPos(handler.window, &(handler.mouseX), &(handler.mouseY));
-            handler.mouseDx = -handler.mouseX + oldMouseX;
-            handler.mouseDy = -handler.mouseY + oldMouseY;
-            update_scene(diff);
-        }
-
         // if the usare wants to change the texture transfer method
         if (changeTexture ) {
             changeTexture = false;
@@ -1165,6 +2782,9 @@ int main(int argc, char* argv[]) {
 
         glfwGetFramebufferSize(handler.window, &handler.windowWidth, &handler.windowHeight);
         glViewport(0, 0, handler.windowWidth, handler.windowHeight);
+        // a minimized window has no size, the last ratio is kept
+        if (handler.windowWidth > 0 && handler.windowHeight > 0)
+            viewAspect = float(handler.windowWidth) / float(handler.windowHeight);
 
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -1173,25 +2793,43 @@ int main(int argc, char* argv[]) {
         drawModels();
 
         glfwSwapBuffers(handler.window);
+        framePacing.endFrame();
         glfwPollEvents();
 
+        // the simulation thread applies the mouse movement in its next step
+        double oldMouseX = handler.mouseX, oldMouseY = handler.mouseY;
+        glfwGetCursorPos(handler.window, &(handler.mouseX), &(handler.mouseY));
+        {
+            std::lock_guard<std::mutex> lock(mouseMovementMutex);
+            mouseMovementX += oldMouseX - handler.mouseX;
+            mouseMovementY += oldMouseY - handler.mouseY;
+        }
+
         CHECK_GL_ERROR();
 
     }
 
     end = true;
-
-
-    // unlock mutexes from the third vertex trasfer method
-    const unsigned int index = (cubeDrawingIndex + numberOfCubeSubbuffers - numberOfCubesPreComputed) % numberOfCubeSubbuffers;    
-    for (size_t i = 0; i < numberOfCubeSubbuffers; i++)
+    simulationThread.join();
     {
-        if(i != index)
-            thidMethodMutex[i].unlock();
+        // wake the texture decoder if it waits for a slot
+        std::lock_guard<std::mutex> lock(textureRingMutex);
+        textureSlotReleased.notify_all();
     }
+    if (textureDecodeThread.joinable())
+        textureDecodeThread.join();
+
+    // wake the thread of methods 2-4 if it waits for the main thread
+    ringPartsReleased.wake();
+    framePacing.wake();
 
     // if the second or third buffer transfer method was used, we need to end their thread
-    if (bufferMethod == 3 || bufferMethod == 2) {
+    if (bufferMethod >= 2 && bufferMethod <= 4) {
+        bufferThread.join();
+        stopUploadHelpers();
+    }
+    if (bufferMethod == 7) {
+        chunkDrawnCondition.notify_one();
         bufferThread.join();
     }
 
@@ -1202,13 +2840,27 @@ int main(int argc, char* argv[]) {
     glDeleteQueries(handler.nTextures* maxCounter, textureQueries);
     glDeleteQueries(maxCounter, vertexQueries);
 
+    // deleting the texture store unmaps it
+    for (size_t slot = 0; slot < textureRingSlots; slot++)
+    {
+        if (textureSlotFence[slot] != nullptr)
+            glDeleteSync(textureSlotFence[slot]);
+    }
+    glDeleteBuffers(1, &textureStore);
+
     // delete alocated memory
+    delete fillPool;
+    delete culler;
+    delete cubeRing;
+    delete residency;
     delete[] handler.keys;
     delete[] handler.specKeys;
 
     // destroy contexts
     glfwDestroyWindow(handler.window);
     glfwDestroyWindow(handler.bufferContextWindow);
+    for (GLFWwindow* window : handler.uploadContextWindows)
+        glfwDestroyWindow(window);
     glfwDestroyWindow(handler.textureContextWindow);
 
     // end the application
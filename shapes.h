@@ -1,7 +1,7 @@
 #pragma once
 #include "glad/glad.h"
 
-static const GLfloat cubeVertices[] = {
+static constexpr GLfloat cubeVertices[] = {
     -1.0f,-1.0f,-1.0f,
     -1.0f,-1.0f, 1.0f,
     -1.0f, 1.0f, 1.0f,
@@ -40,6 +40,144 @@ static const GLfloat cubeVertices[] = {
     1.0f,-1.0f, 1.0f
 };
 
+/// number of vertices of the cube, three for every triangle
+static constexpr unsigned int cubeVertexCount = sizeof(cubeVertices) / sizeof(GLfloat) / 3;
+
+/// interleaved vertices of one cube placed at the origin: position, tex coords and unit normal, 8 floats each
+/// aligned to a cache line, so streaming generators can load whole lines of it
+struct alignas(64) cubeTemplate {
+    GLfloat data[cubeVertexCount * 8];
+};
+
+/// square root usable at compile time (Newton's method)
+constexpr double constexprSqrt(double x) {
+    double root = x > 1.0 ? x : 1.0;
+    for (int i = 0; i < 64; i++)
+        root = 0.5 * (root + x / root);
+    return root;
+}
+
+/// builds the cube template, every vertex gets the unit normal of its own triangle
+constexpr cubeTemplate makeCubeTemplate() {
+    cubeTemplate cube{};
+    for (unsigned int t = 0; t < cubeVertexCount / 3; t++)
+    {
+        const GLfloat* first = cubeVertices + 9 * t;
+        const GLfloat* second = first + 3;
+        const GLfloat* third = first + 6;
+
+        // edges of the triangle and their cross product
+        const double A[3] = { second[0] - first[0], second[1] - first[1], second[2] - first[2] };
+        const double B[3] = { third[0] - first[0], third[1] - first[1], third[2] - first[2] };
+        const double norm[3] = { A[1] * B[2] - A[2] * B[1], A[2] * B[0] - A[0] * B[2], A[0] * B[1] - A[1] * B[0] };
+        const double length = constexprSqrt(norm[0] * norm[0] + norm[1] * norm[1] + norm[2] * norm[2]);
+
+        for (unsigned int j = 0; j < 3; j++)
+        {
+            GLfloat* vertex = cube.data + (3 * t + j) * 8;
+            vertex[0] = first[3 * j];
+            vertex[1] = first[3 * j + 1];
+            vertex[2] = first[3 * j + 2];
+            vertex[3] = 0.0f;
+            vertex[4] = 0.0f;
+            vertex[5] = GLfloat(norm[0] / length);
+            vertex[6] = GLfloat(norm[1] / length);
+            vertex[7] = GLfloat(norm[2] / length);
+        }
+    }
+    return cube;
+}
+
+constexpr bool hasUnitNormals(const cubeTemplate& cube) {
+    for (unsigned int v = 0; v < cubeVertexCount; v++)
+    {
+        const GLfloat* normal = cube.data + v * 8 + 5;
+        if (normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] != 1.0f)
+            return false;
+    }
+    return true;
+}
+
+/// cube template computed by the compiler, generators only add the translation of each cube to it
+static constexpr cubeTemplate cubeVertexTemplate = makeCubeTemplate();
+static_assert(hasUnitNormals(cubeVertexTemplate), "cube normals must have unit length");
+
+/// compact cube vertex: position relative to the origin of its chunk in 1/packedPositionScale units with the chunk index in w,
+/// normal packed as GL_INT_2_10_10_10_REV and no tex coords, 12 bytes instead of 32
+struct packedCubeVertex {
+    GLshort position[4];
+    GLuint normal;
+};
+static_assert(sizeof(packedCubeVertex) == 12, "packed vertex must not be padded");
+
+/// number of units of a packed position per one unit of the scene
+static constexpr int packedPositionScale = 256;
+
+/// packs a normalized signed value to 10 bits of GL_INT_2_10_10_10_REV
+constexpr GLuint packSnorm10(GLfloat value) {
+    return GLuint(int(value * 511.0f + (value < 0 ? -0.5f : 0.5f))) & 0x3FF;
+}
+
+constexpr GLuint packNormal(GLfloat x, GLfloat y, GLfloat z) {
+    return packSnorm10(x) | (packSnorm10(y) << 10) | (packSnorm10(z) << 20);
+}
+
+struct packedCubeTemplate {
+    packedCubeVertex vertices[cubeVertexCount];
+};
+
+/// packed cube placed at the origin of a chunk, generators add the position of the cube inside its chunk and the chunk index
+constexpr packedCubeTemplate makePackedCubeTemplate() {
+    packedCubeTemplate cube{};
+    for (unsigned int v = 0; v < cubeVertexCount; v++)
+    {
+        const GLfloat* vertex = cubeVertexTemplate.data + v * 8;
+        for (unsigned int i = 0; i < 3; i++)
+            cube.vertices[v].position[i] = GLshort(vertex[i] * packedPositionScale);
+        cube.vertices[v].position[3] = 0;
+        cube.vertices[v].normal = packNormal(vertex[5], vertex[6], vertex[7]);
+    }
+    return cube;
+}
+
+static constexpr packedCubeTemplate packedCubeVertexTemplate = makePackedCubeTemplate();
+
+/// faces of the cube in the order +x, -x, +y, -y, +z, -z, each of them made of two triangles
+static constexpr unsigned int cubeFaceCount = 6;
+static constexpr unsigned int faceVertexCount = cubeVertexCount / cubeFaceCount;
+
+/// index of the face of a normal pointing along one axis
+constexpr unsigned int faceOfNormal(const GLfloat* normal) {
+    return normal[0] > 0.5f ? 0 : normal[0] < -0.5f ? 1 : normal[1] > 0.5f ? 2 : normal[1] < -0.5f ? 3 : normal[2] > 0.5f ? 4 : 5;
+}
+
+/// cube templates with vertices grouped by faces, so generators can write only some faces as whole blocks
+struct alignas(64) cubeFaceTemplate {
+    GLfloat data[cubeFaceCount][faceVertexCount * 8];
+    packedCubeVertex packed[cubeFaceCount][faceVertexCount];
+};
+
+/// a face with more than faceVertexCount vertices writes out of its array, which stops the compiler
+constexpr cubeFaceTemplate makeCubeFaceTemplate() {
+    cubeFaceTemplate faces{};
+    unsigned int written[cubeFaceCount] = {};
+    for (unsigned int v = 0; v < cubeVertexCount; v++)
+    {
+        const GLfloat* vertex = cubeVertexTemplate.data + v * 8;
+        const unsigned int face = faceOfNormal(vertex + 5);
+        for (unsigned int i = 0; i < 8; i++)
+            faces.data[face][written[face] * 8 + i] = vertex[i];
+        for (unsigned int i = 0; i < 4; i++)
+            faces.packed[face][written[face]].position[i] = packedCubeVertexTemplate.vertices[v].position[i];
+        faces.packed[face][written[face]].normal = packedCubeVertexTemplate.vertices[v].normal;
+        written[face]++;
+    }
+    return faces;
+}
+
+static_assert(cubeVertexCount == cubeFaceCount * faceVertexCount, "every face must have the same number of vertices");
+static constexpr cubeFaceTemplate cubeVertexFaceTemplate = makeCubeFaceTemplate();
+
 static GLfloat triangleVertices[] = {
     -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 
      0.5f, -0.5f, 0.0f, 1.0f, 0.0f,
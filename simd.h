@@ -0,0 +1,68 @@
+#pragma once
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+/// MSVC lets every function use any intrinsic, so no per-function target is needed
+#define PGR_TARGET_AVX
+#else
+#include <cpuid.h>
+/// GCC and clang only emit AVX instructions inside functions explicitly marked for it
+#define PGR_TARGET_AVX __attribute__((target("avx")))
+#endif
+
+namespace simd {
+
+    /// instruction sets the vertex generators can use, ordered from the slowest to the fastest
+    enum level {
+        scalar = 0,
+        sse2 = 1,
+        avx = 2
+    };
+
+    inline void cpuid(int leaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+        int tmp[4];
+        __cpuid(tmp, leaf);
+        for (int i = 0; i < 4; i++)
+            regs[i] = (unsigned int)tmp[i];
+#else
+        __cpuid(leaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    inline unsigned long long xgetbv(unsigned int index) {
+#if defined(_MSC_VER)
+        return _xgetbv(index);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+        return ((unsigned long long)edx << 32) | eax;
+#endif
+    }
+
+    /// returns the best instruction set supported by both the CPU and the operating system
+    inline level detect() {
+        unsigned int regs[4];
+        cpuid(1, regs);
+
+        const bool hasSSE2 = (regs[3] & (1u << 26)) != 0;
+        const bool hasOSXSAVE = (regs[2] & (1u << 27)) != 0;
+        const bool hasAVX = (regs[2] & (1u << 28)) != 0;
+
+        // AVX registers are only usable if the OS saves the upper halves of ymm registers on context switch
+        if (hasOSXSAVE && hasAVX && (xgetbv(0) & 0x6) == 0x6)
+            return avx;
+        if (hasSSE2)
+            return sse2;
+        return scalar;
+    }
+
+    inline const char* name(level l) {
+        switch (l) {
+        case avx: return "AVX";
+        case sse2: return "SSE2";
+        default: return "scalar";
+        }
+    }
+}
@@ -2,6 +2,7 @@
 
 
 uniform bool useEmissionTexture;
+uniform bool useImpostors;
 
 uniform sampler2D emissionTexture;
 
@@ -30,6 +31,12 @@ uniform mat4 vMatrix;
 uniform mat3 nMatrix;
 
 void main() {
+    // point sprites of far cubes skip the lighting loop, it never lets NdotL below 1, so they are lit fully
+    if (useImpostors) {
+        fragmentColor = vec4(ambient * Lambient + diffuse * Ldiffuse, 1.0);
+        return;
+    }
+
     if (useEmissionTexture) {
         vec3 positionOfLight = (vMatrix * vec4(Lposition, 1.0f)).xyz;
 
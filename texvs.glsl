@@ -3,6 +3,10 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 texCoords;
 layout (location = 2) in vec3 normal;
+// translation of an instance, (0, 0, 0) when the attribute is not enabled
+layout (location = 3) in vec3 instanceOffset;
+// packed cube vertex: position relative to its chunk in xyz and chunk index in w, normal comes packed in location 2
+layout (location = 4) in ivec4 packedPosition;
 
 smooth out vec2 o_texCoords;
 smooth out vec3 o_normal;
@@ -17,11 +21,105 @@ uniform mat3 nMatrix;
 
 uniform bool useEmissionTexture;
 
+// cubes generated from gl_VertexID without any vertex data: proceduralGrid cubes along each axis, proceduralSpacing apart
+uniform bool useProceduralCubes;
+uniform ivec3 proceduralGrid;
+uniform float proceduralSpacing;
+
+// corners of the cube triangles and normals of the triangles, the same as cubeVertices in shapes.h
+const vec3 cubeCorners[36] = vec3[36](
+    vec3(-1.0, -1.0, -1.0),
+    vec3(-1.0, -1.0, 1.0),
+    vec3(-1.0, 1.0, 1.0),
+    vec3(1.0, 1.0, -1.0),
+    vec3(-1.0, -1.0, -1.0),
+    vec3(-1.0, 1.0, -1.0),
+    vec3(1.0, -1.0, 1.0),
+    vec3(-1.0, -1.0, -1.0),
+    vec3(1.0, -1.0, -1.0),
+    vec3(1.0, 1.0, -1.0),
+    vec3(1.0, -1.0, -1.0),
+    vec3(-1.0, -1.0, -1.0),
+    vec3(-1.0, -1.0, -1.0),
+    vec3(-1.0, 1.0, 1.0),
+    vec3(-1.0, 1.0, -1.0),
+    vec3(1.0, -1.0, 1.0),
+    vec3(-1.0, -1.0, 1.0),
+    vec3(-1.0, -1.0, -1.0),
+    vec3(-1.0, 1.0, 1.0),
+    vec3(-1.0, -1.0, 1.0),
+    vec3(1.0, -1.0, 1.0),
+    vec3(1.0, 1.0, 1.0),
+    vec3(1.0, -1.0, -1.0),
+    vec3(1.0, 1.0, -1.0),
+    vec3(1.0, -1.0, -1.0),
+    vec3(1.0, 1.0, 1.0),
+    vec3(1.0, -1.0, 1.0),
+    vec3(1.0, 1.0, 1.0),
+    vec3(1.0, 1.0, -1.0),
+    vec3(-1.0, 1.0, -1.0),
+    vec3(1.0, 1.0, 1.0),
+    vec3(-1.0, 1.0, -1.0),
+    vec3(-1.0, 1.0, 1.0),
+    vec3(1.0, 1.0, 1.0),
+    vec3(-1.0, 1.0, 1.0),
+    vec3(1.0, -1.0, 1.0)
+);
+const vec3 cubeNormals[12] = vec3[12](
+    vec3(-1.0, 0.0, 0.0),
+    vec3(0.0, 0.0, -1.0),
+    vec3(0.0, -1.0, 0.0),
+    vec3(0.0, 0.0, -1.0),
+    vec3(-1.0, 0.0, 0.0),
+    vec3(0.0, -1.0, 0.0),
+    vec3(0.0, 0.0, 1.0),
+    vec3(1.0, 0.0, 0.0),
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+// far cubes are drawn as point sprites of the size of the cube on the screen
+uniform bool useImpostors;
+uniform float impostorPointScale;
+
+uniform bool usePackedVertices;
+// number of chunks along x and y, size of a chunk and units of packed position per scene unit
+uniform ivec2 packedChunkGrid;
+uniform float packedChunkExtent;
+uniform float packedPositionScale;
+
+vec3 vertexPosition() {
+    if (!usePackedVertices)
+        return position;
+
+    int chunk = packedPosition.w;
+    vec3 chunkOrigin = vec3(chunk % packedChunkGrid.x, (chunk / packedChunkGrid.x) % packedChunkGrid.y, chunk / (packedChunkGrid.x * packedChunkGrid.y)) * packedChunkExtent;
+    return chunkOrigin + vec3(packedPosition.xyz) / packedPositionScale;
+}
+
 void main() {
 
-    gl_Position = pvmMatrix * vec4(position, 1.0);
-    vec3 norm = normalize((vMatrix * vec4(nMatrix * normal, 0.0f)).xyz);
-    vec3 pos = (vmMatrix * vec4(position, 1.0)).xyz;
+    vec3 worldPosition;
+    vec3 objectNormal;
+    if (useProceduralCubes) {
+        int cube = gl_VertexID / 36;
+        int corner = gl_VertexID % 36;
+        ivec3 cell = ivec3(cube % proceduralGrid.x, (cube / proceduralGrid.x) % proceduralGrid.y, cube / (proceduralGrid.x * proceduralGrid.y));
+        worldPosition = cubeCorners[corner] + vec3(cell) * proceduralSpacing;
+        objectNormal = cubeNormals[corner / 3];
+    }
+    else {
+        worldPosition = vertexPosition() + instanceOffset;
+        objectNormal = normal;
+    }
+
+    gl_Position = pvmMatrix * vec4(worldPosition, 1.0);
+    if (useImpostors)
+        gl_PointSize = impostorPointScale / gl_Position.w;
+    vec3 norm = normalize((vMatrix * vec4(nMatrix * objectNormal, 0.0f)).xyz);
+    vec3 pos = (vmMatrix * vec4(worldPosition, 1.0)).xyz;
 
     o_texCoords = texCoords;
     o_normal = norm;
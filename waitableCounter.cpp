@@ -0,0 +1,45 @@
+#include "waitableCounter.h"
+#include <thread>
+
+void waitableCounter::wakeSleepers() {
+    // taking the mutex orders the wake after a sleeper checked the counter, so it cannot be lost
+    { std::lock_guard<std::mutex> lock(mutex); }
+    changed.notify_all();
+}
+
+unsigned long long waitableCounter::load() const {
+    return value.load(std::memory_order_acquire);
+}
+
+void waitableCounter::reset(unsigned long long newValue) {
+    value.store(newValue);
+}
+
+void waitableCounter::increase() {
+    // sequentially consistent, so either the sleeper sees the new value or this sees the sleeper
+    value.fetch_add(1);
+    if (sleepers.load() > 0)
+        wakeSleepers();
+}
+
+bool waitableCounter::waitFor(unsigned long long target, bool (*stop)()) {
+    // the other thread usually answers within microseconds, sleeping would cost a scheduler quantum
+    for (int spin = 0; spin < 256; spin++)
+    {
+        if (load() >= target)
+            return true;
+        if (stop())
+            return false;
+        std::this_thread::yield();
+    }
+
+    sleepers.fetch_add(1);
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this, target, stop] { return value.load() >= target || stop(); });
+    sleepers.fetch_sub(1);
+    return value.load() >= target;
+}
+
+void waitableCounter::wake() {
+    wakeSleepers();
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/// counter increased by one thread and waited for by another, like a futex
+/// increasing it costs one atomic store unless a thread sleeps, waiting spins shortly before it sleeps
+class waitableCounter
+{
+protected:
+    std::atomic<unsigned long long> value{ 0 };
+    /// threads sleeping in waitFor, the mutex is taken only when this is not 0
+    std::atomic<unsigned int> sleepers{ 0 };
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    /// wakes threads sleeping in waitFor
+    void wakeSleepers();
+
+public:
+    waitableCounter() = default;
+    waitableCounter(const waitableCounter&) = delete;
+    waitableCounter& operator=(const waitableCounter&) = delete;
+
+    /// memory written before the counter was increased is visible after this returns the increased value
+    unsigned long long load() const;
+
+    /// sets the counter, only when no other thread changes it
+    void reset(unsigned long long newValue);
+
+    /// increases the counter by one and wakes waiting threads
+    void increase();
+
+    /// waits until the counter reaches target or stop returns true, returns false if it was stopped
+    bool waitFor(unsigned long long target, bool (*stop)());
+
+    /// wakes waiting threads to check stop again
+    void wake();
+};
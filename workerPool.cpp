@@ -0,0 +1,76 @@
+#include "workerPool.h"
+
+workerPool::workerPool(unsigned int nThreads) {
+    if (nThreads == 0)
+        nThreads = std::thread::hardware_concurrency();
+    if (nThreads == 0)
+        nThreads = 1;
+
+    for (unsigned int i = 0; i < nThreads; i++)
+        workers.emplace_back(&workerPool::run, this);
+}
+
+workerPool::~workerPool() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ending = true;
+    }
+    jobsReady.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void workerPool::dispatch(unsigned int count, std::function<void(unsigned int)> newJob) {
+    {
+        // jobs of the previous dispatch must not be replaced while workers still use them
+        std::unique_lock<std::mutex> lock(mutex);
+        jobsDone.wait(lock, [this] { return unfinishedJobs == 0 && busyWorkers == 0; });
+        job = std::move(newJob);
+        nJobs = count;
+        nextJob = 0;
+        unfinishedJobs = count;
+        generation++;
+    }
+    jobsReady.notify_all();
+}
+
+void workerPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    jobsDone.wait(lock, [this] { return unfinishedJobs == 0 && busyWorkers == 0; });
+}
+
+unsigned int workerPool::size() const {
+    return (unsigned int)workers.size();
+}
+
+void workerPool::run() {
+    unsigned long long seenGeneration = 0;
+    while (true) {
+        unsigned int count;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobsReady.wait(lock, [&] { return ending || generation != seenGeneration; });
+            if (ending)
+                return;
+            seenGeneration = generation;
+            count = nJobs;
+            busyWorkers++;
+        }
+
+        // take jobs one by one, so faster threads take more of them
+        unsigned int finished = 0;
+        for (unsigned int i = nextJob++; i < count; i = nextJob++) {
+            job(i);
+            finished++;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            unfinishedJobs -= finished;
+            busyWorkers--;
+            if (unfinishedJobs == 0 && busyWorkers == 0)
+                jobsDone.notify_all();
+        }
+    }
+}
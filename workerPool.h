@@ -0,0 +1,52 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <vector>
+
+class workerPool
+{
+protected:
+    /// threads waiting for jobs
+    std::vector<std::thread> workers;
+    /// guards every variable below
+    std::mutex mutex;
+    /// wakes workers up when new jobs are dispatched or the pool is ending
+    std::condition_variable jobsReady;
+    /// wakes up threads waiting for the end of dispatched jobs
+    std::condition_variable jobsDone;
+    /// job called with an index of each dispatched job
+    std::function<void(unsigned int)> job;
+    /// number of dispatched jobs, index of the next job to be taken and number of jobs not finished yet
+    unsigned int nJobs = 0;
+    std::atomic<unsigned int> nextJob{ 0 };
+    unsigned int unfinishedJobs = 0;
+    /// workers still taking jobs of the last dispatch, they must stop before the jobs can be replaced
+    unsigned int busyWorkers = 0;
+    /// increased with every dispatch so workers know there is something new to do
+    unsigned long long generation = 0;
+    bool ending = false;
+
+    /// loop of each worker thread
+    void run();
+
+public:
+    /// creates a pool with nThreads worker threads, 0 means one thread per core
+    explicit workerPool(unsigned int nThreads);
+
+    /// waits for the dispatched jobs and joins all threads
+    ~workerPool();
+
+    workerPool(const workerPool&) = delete;
+    workerPool& operator=(const workerPool&) = delete;
+
+    /// starts jobs with indices 0 to count - 1 and returns without waiting for them, waits for previously dispatched jobs first
+    void dispatch(unsigned int count, std::function<void(unsigned int)> newJob);
+
+    /// blocks until every dispatched job finishes
+    void wait();
+
+    unsigned int size() const;
+};